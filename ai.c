@@ -0,0 +1,207 @@
+#include "ai.h"
+
+#include <string.h>
+
+#include "eval.h"
+#include "search.h"
+
+/* From https://codemyroad.wordpress.com/2013/04/14/tetris-ai-the-near-perfect-player/ */
+const AiWeights ai_default_weights = {
+    .height    = -0.510066,
+    .lines     =  0.760666,
+    .holes     = -0.35663,
+    .bumpiness = -0.184483,
+
+    /* Not used by the original player */
+    .row_transitions = 0,
+    .wells = 0,
+};
+
+static int drop_height(const BoardRow rows[BOARD_ROWS], int x, int y, int shape_number)
+{
+    while (rows_can_fit(rows, x, y + 1, shape_number))
+        ++y;
+
+    return y;
+}
+
+int ai_generate_placements(const BoardRow rows[BOARD_ROWS], const Tetrimino* tetrimino,
+                           Placement placements[AI_MAX_PLACEMENTS])
+{
+    /* Clockwise rotations to do, 3 is a single counter clockwise one */
+    static const int rotations[4] = {0, 1, 3, 2};
+
+    RowWindow done_shapes[4];
+    int nb_done_shapes = 0;
+    int nb_placements = 0;
+
+    for (int r = 0; r < 4; ++r) {
+        int angle = (tetrimino->angle + rotations[r]) % 4;
+        int shape_number = get_shape_nb(tetrimino->type, angle);
+        bool already_done = false;
+
+        /* O, I, S and Z look the same for several angles */
+        for (int i = 0; i < nb_done_shapes; ++i)
+            if (done_shapes[i] == shape_masks[shape_number])
+                already_done = true;
+
+        if (already_done)
+            continue;
+
+        done_shapes[nb_done_shapes++] = shape_masks[shape_number];
+
+        /* The rotation must be possible where the tetrimino is */
+        if (!rows_can_fit(rows, tetrimino->x, tetrimino->y, shape_number))
+            continue;
+
+        if (rotations[r] == 2) {
+            int middle_shape = get_shape_nb(tetrimino->type, (tetrimino->angle + 1) % 4);
+
+            if (!rows_can_fit(rows, tetrimino->x, tetrimino->y, middle_shape))
+                continue;
+        }
+
+        /* Then shift as far as possible on both sides */
+        for (int dir = -1; dir <= 1; dir += 2) {
+            int x = (dir < 0) ? tetrimino->x : tetrimino->x + 1;
+
+            while (rows_can_fit(rows, x, tetrimino->y, shape_number)) {
+                Placement* p = &placements[nb_placements++];
+
+                p->x = x;
+                p->y = drop_height(rows, x, tetrimino->y, shape_number);
+                p->angle = angle;
+                p->shape_number = shape_number;
+
+                x += dir;
+            }
+        }
+    }
+
+    return nb_placements;
+}
+
+double ai_evaluate(const BoardRow rows[BOARD_ROWS], int nb_cleared_lines, const AiWeights* weights)
+{
+    BoardFeatures features;
+
+    eval_board_features(rows, &features);
+
+    return eval_score(&features, nb_cleared_lines, weights);
+}
+
+int ai_choose_among(const Game* game, const AiWeights* weights, const Placement placements[],
+                    int nb_placements)
+{
+    Placement next_placements[AI_MAX_PLACEMENTS];
+    EvalBatch batch;
+    int nb_total_cleared[AI_MAX_PLACEMENTS];
+    double next_scores[AI_MAX_PLACEMENTS];
+    double best_score = 0;
+    int best = -1;
+
+    for (int i = 0; i < nb_placements; ++i) {
+        const Placement* p = &placements[i];
+        BoardRow rows[BOARD_ROWS];
+
+        memcpy(rows, game->board.rows, sizeof(rows));
+        rows_add_shape(rows, p->x, p->y, p->shape_number);
+        int nb_cleared = rows_clear_lines(rows);
+
+        /* Look one piece ahead, the score of a placement is the best one
+         * reachable with the next tetrimino. The boards are scored together */
+        Tetrimino next = make_new_tetrimino(game->ntetr.type);
+        int nb_next = ai_generate_placements(rows, &next, next_placements);
+        double score = AI_LOST_SCORE;
+
+        eval_batch_clear(&batch);
+
+        for (int j = 0; j < nb_next; ++j) {
+            const Placement* q = &next_placements[j];
+            BoardRow next_rows[BOARD_ROWS];
+
+            memcpy(next_rows, rows, sizeof(next_rows));
+            rows_add_shape(next_rows, q->x, q->y, q->shape_number);
+            nb_total_cleared[j] = nb_cleared + rows_clear_lines(next_rows);
+            eval_batch_add(&batch, next_rows);
+        }
+
+        eval_batch_scores(&batch, nb_total_cleared, weights, next_scores);
+
+        for (int j = 0; j < nb_next; ++j)
+            if (next_scores[j] > score)
+                score = next_scores[j];
+
+        if (best < 0 || score > best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+
+    return best;
+}
+
+bool ai_choose_placement(const Game* game, const AiWeights* weights, Placement* best)
+{
+    Placement placements[AI_MAX_PLACEMENTS];
+
+    int nb_placements = ai_generate_placements(game->board.rows, &game->ctetr, placements);
+    int index = ai_choose_among(game, weights, placements, nb_placements);
+
+    if (index < 0)
+        return false;
+
+    *best = placements[index];
+    return true;
+}
+
+void ai_player_init(AiPlayer* player, const AiWeights* weights)
+{
+    player->weights = *weights;
+    player->search = NULL;
+    player->nb_nodes = 0;
+    player->has_target = false;
+}
+
+/* One input per frame: rotate first, then shift, then drop */
+Input ai_player_input(AiPlayer* player, const Game* game)
+{
+    const Tetrimino* ctetr = &game->ctetr;
+
+    if (game->state != GAME_STATE_FALLING) {
+        player->has_target = false;
+        return INPUT_NONE;
+    }
+
+    if (!player->has_target) {
+        bool found;
+
+        if (player->search != NULL) {
+            SearchStats stats;
+
+            found = search_choose_placement(player->search, game, &player->weights,
+                                            &player->target, &stats);
+            player->nb_nodes += stats.nb_nodes;
+        } else {
+            found = ai_choose_placement(game, &player->weights, &player->target);
+        }
+
+        if (!found)
+            return INPUT_NONE;
+
+        player->has_target = true;
+    }
+
+    int rotation = (player->target.angle - ctetr->angle + 4) % 4;
+
+    if (shape_masks[ctetr->shape_number] != shape_masks[player->target.shape_number])
+        return (rotation == 3) ? INPUT_ROTATE_CCW : INPUT_ROTATE_CW;
+
+    if (ctetr->x > player->target.x)
+        return INPUT_LEFT;
+
+    if (ctetr->x < player->target.x)
+        return INPUT_RIGHT;
+
+    return INPUT_DOWN;
+}
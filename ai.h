@@ -0,0 +1,84 @@
+#ifndef AI_H
+#define AI_H
+
+/*
+ * A bot placing pieces by itself.
+ *
+ * For each new piece, every placement reachable by rotating then shifting at
+ * the spawn height and dropping is generated, the resulting boards are scored
+ * with a heuristic, looking one piece ahead with the next tetrimino, and the
+ * inputs to reach the best placement are fed to the game frame by frame.
+ *
+ * Nothing is allocated: boards are small arrays copied on the stack.
+ */
+
+#include <stdbool.h>
+
+#include "core.h"
+
+/* At most 4 angles times every column */
+#define AI_MAX_PLACEMENTS (4 * WINDOW_WIDTH)
+
+/* Score of a board where the game is lost */
+#define AI_LOST_SCORE -1e9
+
+typedef struct AiWeights {
+    double height;      /* Sum of the heights of the columns */
+    double lines;       /* Lines cleared */
+    double holes;       /* Empty cells with a block above them */
+    double bumpiness;   /* Sum of the height differences of adjacent columns */
+    double row_transitions; /* Changes between empty and occupied cells in rows */
+    double wells;       /* Open empty cells between two occupied ones */
+} AiWeights;
+
+extern const AiWeights ai_default_weights;
+
+typedef struct Placement {
+    int x;
+    int y;
+    int angle;
+    int shape_number;
+} Placement;
+
+struct Search;
+
+typedef struct AiPlayer {
+    AiWeights weights;
+
+    /* Search deeper than the next tetrimino with this search (see search.h),
+     * NULL to only look one piece ahead */
+    struct Search* search;
+
+    /* Boards generated by the search so far */
+    long nb_nodes;
+
+    /* Where the current piece is going */
+    Placement target;
+    bool has_target;
+} AiPlayer;
+
+/*
+ * Fill placements with where the tetrimino can end up, starting from its
+ * position and rotating first then shifting. Placements with the same shape
+ * are only generated once. Returns the number of placements.
+ */
+int ai_generate_placements(const BoardRow rows[BOARD_ROWS], const Tetrimino* tetrimino,
+                           Placement placements[AI_MAX_PLACEMENTS]);
+
+/* Score the board, higher is better */
+double ai_evaluate(const BoardRow rows[BOARD_ROWS], int nb_cleared_lines, const AiWeights* weights);
+
+/* The best of the given placements of the current tetrimino, looking one piece
+ * ahead. Returns its index, -1 if there is none */
+int ai_choose_among(const Game* game, const AiWeights* weights, const Placement placements[],
+                    int nb_placements);
+
+/* Returns false if the current tetrimino can't be placed anywhere */
+bool ai_choose_placement(const Game* game, const AiWeights* weights, Placement* best);
+
+void ai_player_init(AiPlayer* player, const AiWeights* weights);
+
+/* The input to give to the game this frame */
+Input ai_player_input(AiPlayer* player, const Game* game);
+
+#endif
@@ -0,0 +1,469 @@
+#include "ansi.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "render.h"
+
+/* A color pair of render.c, 0 for the default colors */
+#define STYLE_COLOR 0x07
+
+/* Blocks are spaces in reverse video, so in the color of the pair */
+#define STYLE_REVERSE 0x08
+
+/* The glyph is from the DEC line drawing set, like the ACS_ characters */
+#define STYLE_GRAPHICS 0x10
+
+/* A cell nothing is drawn with, to force a cell to be drawn again */
+#define GLYPH_UNKNOWN '\0'
+
+typedef struct Cell {
+    char glyph;
+    unsigned char style;
+} Cell;
+
+/* Sequences of the cells of a frame in the worst case: a cursor move, a
+ * change of character set and of colors, then the glyph */
+#define MAX_CELL_BYTES 32
+#define OUTPUT_CAPACITY (ANSI_ROWS * ANSI_COLUMNS * MAX_CELL_BYTES)
+
+AnsiStats ansi_stats;
+
+/* What should be on screen, and what the terminal shows */
+static Cell screen[ANSI_ROWS][ANSI_COLUMNS];
+static Cell shown[ANSI_ROWS][ANSI_COLUMNS];
+
+static char output[OUTPUT_CAPACITY];
+static int output_size;
+static int output_fd;
+
+/* State of the terminal after the output so far, -1 when unknown */
+static int cursor_y;
+static int cursor_x;
+static int current_style;
+
+static bool is_terminal;
+
+/* The frame timings and the hint, if the terminal is big enough */
+static bool show_right_boxes;
+static struct termios saved_termios;
+
+/* Same colors as the pairs of init_windows */
+static const char color_codes[8] = {0, '6', '3', '5', 0, '4', '1', '2'};
+
+static void append(const char* bytes, int size)
+{
+    memcpy(&output[output_size], bytes, size);
+    output_size += size;
+}
+
+static void append_number(int n)
+{
+    char digits[12];
+    int nb_digits = 0;
+
+    do {
+        digits[nb_digits++] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+
+    while (nb_digits > 0)
+        output[output_size++] = digits[--nb_digits];
+}
+
+/* How long a frame waits for a terminal which doesn't take its output */
+#define OUTPUT_TIMEOUT_MS 100
+
+static void send_output()
+{
+    int sent = 0;
+
+    while (sent < output_size) {
+        ssize_t size = write(output_fd, &output[sent], output_size - sent);
+
+        ++ansi_stats.nb_writes;
+
+        if (size > 0) {
+            sent += size;
+            continue;
+        }
+
+        if (size < 0 && errno == EINTR)
+            continue;
+
+        /* The output may be non-blocking, wait until it takes more */
+        struct pollfd writable = {.fd = output_fd, .events = POLLOUT};
+
+        if (size < 0 && errno == EAGAIN && poll(&writable, 1, OUTPUT_TIMEOUT_MS) > 0)
+            continue;
+
+        /* Drop the rest of the frame rather than spin, and draw everything
+         * again the next one as the terminal missed some of it */
+        ansi_invalidate();
+        break;
+    }
+
+    ansi_stats.nb_bytes += sent;
+    output_size = 0;
+}
+
+static void move_cursor(int y, int x)
+{
+    if (y == cursor_y && x == cursor_x)
+        return;
+
+    int gap = x - cursor_x;
+
+    /* Writing again a few unchanged cells is shorter than moving over them,
+     * as long as they don't need other colors */
+    if (y == cursor_y && gap > 0 && gap <= 3) {
+        bool same_style = true;
+
+        for (int i = cursor_x; i < x; ++i)
+            same_style = same_style && shown[y][i].style == current_style;
+
+        if (same_style) {
+            for (int i = cursor_x; i < x; ++i)
+                output[output_size++] = shown[y][i].glyph;
+
+            cursor_x = x;
+            return;
+        }
+    }
+
+    if (y == cursor_y && gap > 0) {
+        append("\033[", 2);
+        append_number(gap);
+        append("C", 1);
+    } else {
+        append("\033[", 2);
+        append_number(y + 1);
+        append(";", 1);
+        append_number(x + 1);
+        append("H", 1);
+    }
+
+    cursor_y = y;
+    cursor_x = x;
+}
+
+static void set_style(int style)
+{
+    if (style == current_style)
+        return;
+
+    if (current_style < 0 || ((style ^ current_style) & STYLE_GRAPHICS))
+        append((style & STYLE_GRAPHICS) ? "\033(0" : "\033(B", 3);
+
+    if (current_style < 0 || ((style ^ current_style) & (STYLE_COLOR | STYLE_REVERSE))) {
+        append("\033[0", 3);
+
+        if (style & STYLE_REVERSE)
+            append(";7", 2);
+
+        if (color_codes[style & STYLE_COLOR] != 0) {
+            append(";3", 2);
+            append(&color_codes[style & STYLE_COLOR], 1);
+        }
+
+        append("m", 1);
+    }
+
+    current_style = style;
+}
+
+/* Send the cells which changed since the last frame */
+static void flush_screen()
+{
+    for (int y = 0; y < ANSI_ROWS; ++y) {
+        if (memcmp(screen[y], shown[y], sizeof(screen[y])) == 0)
+            continue;
+
+        for (int x = 0; x < ANSI_COLUMNS; ++x) {
+            Cell cell = screen[y][x];
+
+            if (cell.glyph == shown[y][x].glyph && cell.style == shown[y][x].style)
+                continue;
+
+            move_cursor(y, x);
+            set_style(cell.style);
+            output[output_size++] = cell.glyph;
+
+            shown[y][x] = cell;
+            ++cursor_x;
+        }
+    }
+
+    if (output_size > 0) {
+        ++ansi_stats.nb_frames;
+        send_output();
+    }
+}
+
+static void put(int y, int x, char glyph, int style)
+{
+    if (y >= 0 && y < ANSI_ROWS && x >= 0 && x < ANSI_COLUMNS)
+        screen[y][x] = (Cell) {glyph, style};
+}
+
+static void put_text(int y, int x, const char* format, ...)
+{
+    char text[ANSI_COLUMNS + 1];
+    va_list arguments;
+
+    va_start(arguments, format);
+    vsnprintf(text, sizeof(text), format, arguments);
+    va_end(arguments);
+
+    for (int i = 0; text[i] != '\0'; ++i)
+        put(y, x + i, text[i], 0);
+}
+
+static void clear_area(int y, int x, int height, int width)
+{
+    for (int i = 0; i < height; ++i)
+        for (int j = 0; j < width; ++j)
+            put(y + i, x + j, ' ', 0);
+}
+
+/* Like box() of ncurses, with a title like the windows have */
+static void draw_box(int y, int x, int height, int width, const char* title)
+{
+    for (int j = 1; j < width - 1; ++j) {
+        put(y, x + j, 'q', STYLE_GRAPHICS);
+        put(y + height - 1, x + j, 'q', STYLE_GRAPHICS);
+    }
+
+    for (int i = 1; i < height - 1; ++i) {
+        put(y + i, x, 'x', STYLE_GRAPHICS);
+        put(y + i, x + width - 1, 'x', STYLE_GRAPHICS);
+    }
+
+    put(y, x, 'l', STYLE_GRAPHICS);
+    put(y, x + width - 1, 'k', STYLE_GRAPHICS);
+    put(y + height - 1, x, 'm', STYLE_GRAPHICS);
+    put(y + height - 1, x + width - 1, 'j', STYLE_GRAPHICS);
+
+    if (title != NULL)
+        put_text(y, x + 1, "%s", title);
+}
+
+static void restore_terminal()
+{
+    static const char reset[] = "\033[0m\033(B\033[?25h\033[?1049l";
+
+    if (write(output_fd, reset, sizeof(reset) - 1) < 0) {
+        /* Nothing more can be done */
+    }
+
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_termios);
+}
+
+/* Give the terminal back before dying of a signal, as ncurses does */
+static void handle_signal(int signal_number)
+{
+    restore_terminal();
+    signal(signal_number, SIG_DFL);
+    raise(signal_number);
+}
+
+bool ansi_init(int fd)
+{
+    output_fd = fd;
+    is_terminal = isatty(fd) && isatty(STDIN_FILENO);
+    show_right_boxes = true;
+
+    if (is_terminal) {
+        struct termios termios;
+        struct winsize size;
+
+        if (tcgetattr(STDIN_FILENO, &saved_termios) != 0)
+            return false;
+
+        /* Keys are read one by one and not echoed, like with cbreak() */
+        termios = saved_termios;
+        termios.c_lflag &= ~(ICANON | ECHO);
+        termios.c_cc[VMIN] = 1;
+        termios.c_cc[VTIME] = 0;
+
+        if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &termios) != 0)
+            return false;
+
+        signal(SIGINT, handle_signal);
+        signal(SIGTERM, handle_signal);
+
+        /* Alternate screen, hidden cursor */
+        static const char setup[] = "\033[?1049h\033[?25l\033[2J";
+
+        append(setup, sizeof(setup) - 1);
+        send_output();
+
+        if (ioctl(fd, TIOCGWINSZ, &size) == 0)
+            show_right_boxes = size.ws_col >= ANSI_COLUMNS && size.ws_row >= ANSI_ROWS;
+    }
+
+    for (int y = 0; y < ANSI_ROWS; ++y)
+        for (int x = 0; x < ANSI_COLUMNS; ++x)
+            screen[y][x] = (Cell) {' ', 0};
+
+    /* Boxes which are never redrawn, like in init_windows */
+    draw_box(0, 0, WINDOW_HEIGHT + 2, 2*WINDOW_WIDTH + 2, NULL);
+
+    ansi_invalidate();
+
+    return true;
+}
+
+void ansi_deinit()
+{
+    if (!is_terminal)
+        return;
+
+    restore_terminal();
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+}
+
+void ansi_invalidate()
+{
+    memset(shown, GLYPH_UNKNOWN, sizeof(shown));
+
+    cursor_y = -1;
+    cursor_x = -1;
+    current_style = -1;
+}
+
+static void draw_cells(const unsigned char cells[WINDOW_HEIGHT][WINDOW_WIDTH])
+{
+    for (int y = 0; y < WINDOW_HEIGHT; ++y) {
+        for (int x = 0; x < WINDOW_WIDTH; ++x) {
+            unsigned char cell = cells[y][x];
+            char glyph = ' ';
+            int style = 0;
+
+            if (cell == CELL_GHOST) {
+                put(1 + y, 1 + 2*x, '[', 0);
+                put(1 + y, 2 + 2*x, ']', 0);
+                continue;
+            }
+
+            if (cell == CELL_HIGHLIGHT) {
+                glyph = 'a';
+                style = STYLE_GRAPHICS;
+            } else if (cell != BLOCK_TYPE_NONE) {
+                style = STYLE_REVERSE | cell;
+            }
+
+            put(1 + y, 1 + 2*x, glyph, style);
+            put(1 + y, 2 + 2*x, glyph, style);
+        }
+    }
+}
+
+static void draw_counter(int y, const char* title, long value)
+{
+    draw_box(y, 2*WINDOW_WIDTH + 2, 1 + 2, WINDOW_WIDTH + 2, title);
+    put_text(y + 1, 2*WINDOW_WIDTH + 3, "%-*ld", WINDOW_WIDTH, value);
+}
+
+static void draw_next_piece(const Tetrimino* ntetr)
+{
+    int center_length = center_lengths[ntetr->type - 1];
+    int top = 9;
+    int left = 2*WINDOW_WIDTH + 2;
+
+    clear_area(top, left, 2 + 2, WINDOW_WIDTH + 2);
+    draw_box(top, left, 2 + 2, WINDOW_WIDTH + 2, "Next");
+
+    for (int i = 0; i < 4; ++i) {
+        int x = shapes[ntetr->shape_number][i][0];
+        int y = shapes[ntetr->shape_number][i][1];
+
+        put(top + 1 + y, left + 1 + center_length + 2*x, ' ', STYLE_REVERSE | ntetr->type);
+        put(top + 1 + y, left + 2 + center_length + 2*x, ' ', STYLE_REVERSE | ntetr->type);
+    }
+}
+
+void ansi_draw_game(const Game* game, long highscore)
+{
+    unsigned char cells[WINDOW_HEIGHT][WINDOW_WIDTH];
+
+    /* Everything is drawn on the grid, only the changes are sent */
+    compose_game(game, cells);
+    draw_cells(cells);
+
+    draw_counter(14, "Score", game->score);
+    draw_counter(2, "Level", game->level);
+    draw_next_piece(&game->ntetr);
+    draw_counter(17, "Highscore", highscore);
+    draw_counter(5, "Lines", game->cleared_lines);
+
+    flush_screen();
+}
+
+void ansi_draw_falling_curtain(int nb_frames)
+{
+    for (int j = 0; j < nb_frames / curtain_frame_freq && j < WINDOW_HEIGHT; ++j)
+        for (int i = 0; i < 2*WINDOW_WIDTH; ++i)
+            put(1 + j, 1 + i, 'a', STYLE_GRAPHICS | 4);
+
+    flush_screen();
+}
+
+void ansi_draw_pause()
+{
+    draw_box(WINDOW_HEIGHT / 2, 7, 3, 8, NULL);
+    put_text(WINDOW_HEIGHT / 2 + 1, 8, "Paused");
+
+    flush_screen();
+}
+
+void ansi_draw_frame_stats(const PhaseSummary summaries[NB_FRAME_PHASES], int nb_frames)
+{
+    if (!show_right_boxes)
+        return;
+
+    int top = 14;
+    int left = 3*WINDOW_WIDTH + 4;
+
+    clear_area(top, left, NB_FRAME_PHASES + 3, 34);
+    draw_box(top, left, NB_FRAME_PHASES + 3, 34, NULL);
+    put_text(top, left + 1, "Frame times (us, %d frames)", nb_frames);
+    put_text(top + 1, left + 1, "%-6s %7s %7s %7s", "", "p50", "p99", "max");
+
+    for (int phase = 0; phase < NB_FRAME_PHASES; ++phase)
+        put_text(top + 2 + phase, left + 1, "%-6s %7.1f %7.1f %7.1f",
+                 frame_phase_names[phase], summaries[phase].p50_ns / 1e3,
+                 summaries[phase].p99_ns / 1e3, summaries[phase].max_ns / 1e3);
+}
+
+void ansi_hide_frame_stats()
+{
+    clear_area(14, 3*WINDOW_WIDTH + 4, NB_FRAME_PHASES + 3, 34);
+}
+
+void ansi_draw_hint(const char* inputs, int nb_frames, int nb_presses)
+{
+    if (!show_right_boxes)
+        return;
+
+    int top = 2;
+    int left = 3*WINDOW_WIDTH + 4;
+
+    clear_area(top, left, 2 + 2, 34);
+    draw_box(top, left, 2 + 2, 34, "Hint");
+    put_text(top + 1, left + 1, "%.32s", inputs);
+    put_text(top + 2, left + 1, "%d frames, %d presses", nb_frames, nb_presses);
+}
+
+void ansi_hide_hint()
+{
+    clear_area(2, 3*WINDOW_WIDTH + 4, 2 + 2, 34);
+}
@@ -0,0 +1,55 @@
+#ifndef ANSI_H
+#define ANSI_H
+
+/*
+ * Rendering straight to the terminal with ANSI escape sequences, without
+ * ncurses (--ansi).
+ *
+ * Everything is drawn on a grid of cells mirroring the screen, with the same
+ * layout as the ncurses windows. Once per frame, the cells which differ from
+ * what the terminal shows are turned into escape sequences in a buffer
+ * allocated once, only moving the cursor when the next cell isn't under it and
+ * only changing colors when they differ from the last cell written, and the
+ * buffer is sent with a single write().
+ */
+
+#include <stdbool.h>
+
+#include "core.h"
+#include "frame_stats.h"
+
+/* The whole layout, the frame timings box being the rightmost one */
+#define ANSI_COLUMNS (3*WINDOW_WIDTH + 4 + 34)
+#define ANSI_ROWS ((WINDOW_HEIGHT + 2 > 14 + NB_FRAME_PHASES + 3) \
+                   ? WINDOW_HEIGHT + 2 : 14 + NB_FRAME_PHASES + 3)
+
+typedef struct AnsiStats {
+    /* Frames which changed something on screen */
+    long nb_frames;
+
+    long nb_writes;
+    long nb_bytes;
+} AnsiStats;
+
+extern AnsiStats ansi_stats;
+
+/* Draw to fd. If it is a terminal, it is switched to the alternate screen and
+ * the keyboard to cbreak mode until ansi_deinit */
+bool ansi_init(int fd);
+void ansi_deinit();
+
+/* Forget what is on screen, so the next frame is drawn entirely */
+void ansi_invalidate();
+
+void ansi_draw_game(const Game* game, long highscore);
+void ansi_draw_falling_curtain(int nb_frames);
+void ansi_draw_pause();
+
+/* Sent to the terminal with the next frame */
+void ansi_draw_frame_stats(const PhaseSummary summaries[NB_FRAME_PHASES], int nb_frames);
+void ansi_hide_frame_stats();
+
+void ansi_draw_hint(const char* inputs, int nb_frames, int nb_presses);
+void ansi_hide_hint();
+
+#endif
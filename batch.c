@@ -0,0 +1,295 @@
+/*
+ * Run many games played by the AI, without a terminal, on all cores.
+ *
+ *   ./tetris-batch [--games N] [--threads N] [--seed N] [--level N] [--max-pieces N]
+ *                  [--depth N] [--beam N] [--nodes N]
+ *
+ * The games are split between the workers, each one running its own games
+ * with its own board and piece generator. A worker which is done with its own
+ * games steals the remaining ones from the others, so a few long games don't
+ * leave cores idle.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ai.h"
+#include "core.h"
+#include "search.h"
+
+#define MAX_THREADS 256
+
+typedef struct GameResult {
+    long score;
+    int lines;
+    int level;
+    long pieces;
+    long frames;
+    long nodes;
+} GameResult;
+
+/*
+ * The games not started yet of a worker, as a range of game indices packed in
+ * a single word, so the owner can take from the front and thieves from the
+ * back with a compare and swap.
+ */
+typedef struct WorkQueue {
+    _Atomic uint64_t range;
+    char padding[64 - sizeof(uint64_t)];
+} WorkQueue;
+
+int nb_games = 1000;
+int nb_threads = 0;
+int first_seed = 2;
+int start_level = 0;
+long max_pieces = 10000;
+
+/* Use the deeper search when --depth is given, one thread per game as all the
+ * cores are already busy, and no time limit so results don't depend on the
+ * load of the machine */
+bool use_search = false;
+SearchLimits search_limits;
+
+WorkQueue queues[MAX_THREADS];
+GameResult* results;
+
+static uint64_t make_range(uint32_t front, uint32_t back)
+{
+    return (uint64_t)front << 32 | back;
+}
+
+/* Returns the index of a game, or -1 if the queue is empty */
+static int pop_front(WorkQueue* queue)
+{
+    uint64_t range = atomic_load(&queue->range);
+
+    for (;;) {
+        uint32_t front = range >> 32;
+        uint32_t back = range & 0xFFFFFFFF;
+
+        if (front >= back)
+            return -1;
+
+        if (atomic_compare_exchange_weak(&queue->range, &range, make_range(front + 1, back)))
+            return front;
+    }
+}
+
+static int steal_back(WorkQueue* queue)
+{
+    uint64_t range = atomic_load(&queue->range);
+
+    for (;;) {
+        uint32_t front = range >> 32;
+        uint32_t back = range & 0xFFFFFFFF;
+
+        if (front >= back)
+            return -1;
+
+        if (atomic_compare_exchange_weak(&queue->range, &range, make_range(front, back - 1)))
+            return back - 1;
+    }
+}
+
+/*
+ * Seeds differing only by their lowest bit give the same register after the
+ * first step, so every other seed is skipped to avoid playing a game twice.
+ * This leaves MAX_GAMES pairs once the one of seed 0, replaced by the default
+ * seed, is skipped too, which the seeds go through from the first one.
+ */
+#define MAX_GAMES 32767
+
+static uint16_t game_seed(int index)
+{
+    int pair = ((first_seed & 0xFFFF) / 2 + index + MAX_GAMES - 1) % MAX_GAMES + 1;
+
+    return 2 * pair | (first_seed & 1);
+}
+
+static void play_game(int index, Search* search)
+{
+    Game game;
+    AiPlayer ai;
+    GameResult* result = &results[index];
+
+    game_init(&game, start_level, game_seed(index));
+    ai_player_init(&ai, &ai_default_weights);
+
+    ai.search = search;
+
+    result->frames = 0;
+
+    while (game.state != GAME_STATE_OVER && game.nb_pieces < max_pieces) {
+        game_step(&game, ai_player_input(&ai, &game));
+        ++result->frames;
+    }
+
+    result->score = game.score;
+    result->lines = game.cleared_lines;
+    result->level = game.level;
+    result->pieces = game.nb_pieces;
+    result->nodes = ai.nb_nodes;
+}
+
+static void* worker(void* arg)
+{
+    int id = (int)(intptr_t)arg;
+    int index;
+
+    /* Reused by every game of the thread */
+    Search* search = use_search ? search_create(&search_limits) : NULL;
+
+    while ((index = pop_front(&queues[id])) >= 0)
+        play_game(index, search);
+
+    /* Help the others */
+    for (int i = 1; i < nb_threads; ++i) {
+        WorkQueue* victim = &queues[(id + i) % nb_threads];
+
+        while ((index = steal_back(victim)) >= 0)
+            play_game(index, search);
+    }
+
+    if (search != NULL)
+        search_destroy(search);
+
+    return NULL;
+}
+
+static double now_s()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void print_stat(const char* name, double total, double min, double max)
+{
+    printf("%-8s mean %12.1f   min %10.0f   max %10.0f\n", name, total / nb_games, min, max);
+}
+
+static void print_summary(double elapsed)
+{
+    double total[4] = {0}, min[4] = {0}, max[4] = {0};
+    long total_frames = 0;
+    long total_nodes = 0;
+
+    for (int i = 0; i < nb_games; ++i) {
+        double values[4] = {
+            results[i].score, results[i].lines, results[i].level, results[i].pieces,
+        };
+
+        for (int j = 0; j < 4; ++j) {
+            total[j] += values[j];
+
+            if (i == 0 || values[j] < min[j])
+                min[j] = values[j];
+
+            if (i == 0 || values[j] > max[j])
+                max[j] = values[j];
+        }
+
+        total_frames += results[i].frames;
+        total_nodes += results[i].nodes;
+    }
+
+    printf("%d games on %d threads in %.2f s: %.1f games/s, %.0f frames/s\n",
+           nb_games, nb_threads, elapsed, nb_games / elapsed, total_frames / elapsed);
+
+    print_stat("Score", total[0], min[0], max[0]);
+    print_stat("Lines", total[1], min[1], max[1]);
+    print_stat("Level", total[2], min[2], max[2]);
+    print_stat("Pieces", total[3], min[3], max[3]);
+
+    if (use_search)
+        printf("Search: %ld nodes, %.0f nodes/s, %.0f nodes/piece\n", total_nodes,
+               total_nodes / elapsed, total_nodes / total[3]);
+}
+
+int main(int argc, char* argv[])
+{
+    search_limits = search_default_limits;
+    search_limits.max_time_ns = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "--games") == 0)
+            nb_games = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0)
+            nb_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0)
+            first_seed = strtol(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--level") == 0)
+            start_level = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-pieces") == 0)
+            max_pieces = atol(argv[++i]);
+        else if (strcmp(argv[i], "--depth") == 0) {
+            use_search = true;
+            search_limits.depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--beam") == 0)
+            search_limits.beam_width = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--nodes") == 0)
+            search_limits.max_nodes = atol(argv[++i]);
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (nb_threads <= 0)
+        nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (nb_threads > MAX_THREADS)
+        nb_threads = MAX_THREADS;
+
+    if (nb_games <= 0)
+        return 0;
+
+    if (nb_games > MAX_GAMES) {
+        fprintf(stderr, "At most %d games have different pieces\n", MAX_GAMES);
+        return 1;
+    }
+
+    results = calloc(nb_games, sizeof(GameResult));
+
+    if (results == NULL) {
+        fprintf(stderr, "Not enough memory for %d games\n", nb_games);
+        return 1;
+    }
+
+    /* Give every worker its share of the games */
+    for (int i = 0; i < nb_threads; ++i) {
+        uint32_t front = (long)nb_games * i / nb_threads;
+        uint32_t back = (long)nb_games * (i + 1) / nb_threads;
+        atomic_init(&queues[i].range, make_range(front, back));
+    }
+
+    pthread_t threads[MAX_THREADS];
+    double start = now_s();
+
+    for (int i = 0; i < nb_threads; ++i) {
+        if (pthread_create(&threads[i], NULL, worker, (void*)(intptr_t)i) != 0) {
+            fprintf(stderr, "Could not start %d threads\n", nb_threads);
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < nb_threads; ++i)
+        pthread_join(threads[i], NULL);
+
+    print_summary(now_s() - start);
+
+    free(results);
+
+    return 0;
+}
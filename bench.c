@@ -0,0 +1,457 @@
+/*
+ * Microbenchmarks, run with `make bench`, to catch regressions in the hot
+ * paths of the game.
+ *
+ * Every benchmark runs once to warm up, then NB_REPETITIONS times, and
+ * reports the median time per operation with the spread of the repetitions.
+ * The core functions are timed on boards and pieces taken from a game played
+ * by the bot, so they see the same data as in a real game.
+ *
+ * Drawing is done on a terminal writing to a temporary file, so only the cost
+ * of our code and of ncurses is measured, not the one of a terminal emulator,
+ * and the bytes sent per frame by both backends can be compared.
+ */
+
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "ai.h"
+#include "ansi.h"
+#include "core.h"
+#include "eval.h"
+#include "path.h"
+#include "render.h"
+
+#define NB_REPETITIONS 11
+
+#define NB_BOARDS 64
+
+/* Consecutive frames of a game, and states right after a piece completed
+ * lines */
+#define NB_FRAMES 4096
+#define NB_CLEARS 256
+
+/* Positions tested by the collision benchmarks */
+#define NB_QUERIES 4096
+
+Game frames[NB_FRAMES];
+Game clears[NB_CLEARS];
+
+typedef struct Query {
+    int frame;
+    int x;
+    int y;
+    int shape_number;
+} Query;
+
+Query queries[NB_QUERIES];
+
+/* Boards drawn by the rendering benchmarks, cycled through */
+unsigned char boards[NB_BOARDS][WINDOW_HEIGHT][WINDOW_WIDTH];
+
+double now_s()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Keep the compiler from optimizing a result away */
+#define KEEP(value) __asm__ volatile("" : : "r"(value) : "memory")
+
+/*
+ * Time the code given after the name, run nb_iterations times per repetition,
+ * where each iteration does nb_ops operations. The iteration index is i.
+ */
+#define BENCH(name, nb_iterations, nb_ops, ...)                                         \
+    do {                                                                                \
+        double samples[NB_REPETITIONS];                                                 \
+                                                                                        \
+        for (int rep = -1; rep < NB_REPETITIONS; ++rep) {                               \
+            double start = now_s();                                                     \
+                                                                                        \
+            for (long i = 0; i < (nb_iterations); ++i) {                                \
+                __VA_ARGS__;                                                            \
+            }                                                                           \
+                                                                                        \
+            if (rep >= 0)                                                               \
+                samples[rep] = (now_s() - start) * 1e9 / ((double)(nb_iterations) * (nb_ops)); \
+        }                                                                               \
+                                                                                        \
+        print_result(name, samples);                                                    \
+    } while (0)
+
+static int compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Cells drawn by an operation, to also print the cells per second when set */
+double cells_per_op = 0;
+
+void print_result(const char* name, double samples[NB_REPETITIONS])
+{
+    qsort(samples, NB_REPETITIONS, sizeof(double), compare_doubles);
+
+    printf("  %-34s %10.2f ns/op   min %10.2f   max %10.2f", name,
+           samples[NB_REPETITIONS / 2], samples[0], samples[NB_REPETITIONS - 1]);
+
+    if (cells_per_op > 0)
+        printf("   %6.1f Mcells/s", cells_per_op / samples[NB_REPETITIONS / 2] * 1e3);
+
+    printf("\n");
+}
+
+/*
+ * Let the bot play a game and keep consecutive frames once the board has some
+ * blocks, the states where lines were completed, and positions next to the
+ * falling piece for the collision tests.
+ */
+void generate_game_data()
+{
+    Game game;
+    AiPlayer ai;
+    unsigned int seed = 42;
+    int nb_frames = 0;
+    int nb_clears = 0;
+
+    game_init(&game, 0, 42);
+    ai_player_init(&ai, &ai_default_weights);
+
+    for (long frame = 0; nb_frames < NB_FRAMES || nb_clears < NB_CLEARS; ++frame) {
+        bool locked = game_step(&game, ai_player_input(&ai, &game));
+
+        if (game.state == GAME_STATE_OVER) {
+            fprintf(stderr, "The bot lost the game used by the benchmarks\n");
+            exit(1);
+        }
+
+        if (locked && game.state == GAME_STATE_LINE_CLEAR && nb_clears < NB_CLEARS)
+            clears[nb_clears++] = game;
+
+        if (frame >= 2000 && nb_frames < NB_FRAMES)
+            frames[nb_frames++] = game;
+    }
+
+    for (int i = 0; i < NB_QUERIES; ++i) {
+        Query* query = &queries[i];
+        const Tetrimino* ctetr = &frames[i % NB_FRAMES].ctetr;
+
+        query->frame = i % NB_FRAMES;
+        query->x = ctetr->x + rand_r(&seed) % 3 - 1;
+        query->y = ctetr->y + rand_r(&seed) % 2;
+        query->shape_number = get_shape_nb(ctetr->type, rand_r(&seed) % 4);
+
+        if (query->y > WINDOW_HEIGHT)
+            query->y = WINDOW_HEIGHT;
+    }
+}
+
+/* Random boards, filled from the bottom up to a random height */
+void generate_boards()
+{
+    unsigned int seed = 42;
+
+    for (int b = 0; b < NB_BOARDS; ++b) {
+        int height = rand_r(&seed) % WINDOW_HEIGHT;
+
+        for (int y = 0; y < WINDOW_HEIGHT; ++y)
+            for (int x = 0; x < WINDOW_WIDTH; ++x)
+                boards[b][y][x] = (y >= WINDOW_HEIGHT - height && rand_r(&seed) % 8)
+                    ? 1 + rand_r(&seed) % 7 : BLOCK_TYPE_NONE;
+    }
+}
+
+/* How the board used to be drawn: loop over it once per color, so the
+ * attributes only change 7 times */
+void display_cells_by_color(const unsigned char cells[WINDOW_HEIGHT][WINDOW_WIDTH])
+{
+    werase(game_box);
+    box(game_box, ACS_VLINE, ACS_HLINE);
+
+    for (BlockType color = 1; color <= 7; ++color) {
+        wattron(game_box, COLOR_PAIR(color));
+
+        for (int x = 0; x < WINDOW_WIDTH; ++x)
+            for (int y = 0; y < WINDOW_HEIGHT; ++y)
+                if (cells[y][x] == color)
+                    print_pixel(x, y, game_box);
+
+        wattroff(game_box, COLOR_PAIR(color));
+    }
+
+    wnoutrefresh(game_box);
+}
+
+/* How it is drawn now: a single pass with runs of the same color, see
+ * display_cells. Every frame is drawn entirely, to compare the same work. */
+void display_cells_by_run(const unsigned char cells[WINDOW_HEIGHT][WINDOW_WIDTH])
+{
+    invalidate_screen();
+    display_cells(cells);
+}
+
+/* A full batch of boards, as occupancy rows, filled like the ones above */
+void generate_batch(EvalBatch* batch)
+{
+    unsigned int seed = 42;
+
+    eval_batch_clear(batch);
+
+    for (int b = 0; b < EVAL_BATCH_SIZE; ++b) {
+        BoardRow rows[BOARD_ROWS];
+        int height = rand_r(&seed) % WINDOW_HEIGHT;
+
+        for (int y = 0; y < BOARD_ROWS; ++y)
+            rows[y] = EMPTY_ROW;
+
+        for (int y = WINDOW_HEIGHT - height; y < WINDOW_HEIGHT; ++y)
+            rows[BOARD_TOP + y] |= rand_r(&seed) & ~EMPTY_ROW;
+
+        eval_batch_add(batch, rows);
+    }
+}
+
+void bench_core()
+{
+    printf("Game core\n");
+
+    BENCH("shape_can_fit", 4000000, 1, {
+        const Query* q = &queries[i % NB_QUERIES];
+        KEEP(shape_can_fit(&frames[q->frame], q->x, q->y, q->shape_number));
+    });
+
+    BENCH("can_move_down", 4000000, 1, KEEP(can_move_down(&frames[i % NB_FRAMES])));
+    BENCH("can_move_left", 4000000, 1, KEEP(can_move_left(&frames[i % NB_FRAMES])));
+    BENCH("can_move_right", 4000000, 1, KEEP(can_move_right(&frames[i % NB_FRAMES])));
+
+    BENCH("check_for_complete_lines", 1000000, 1,
+          KEEP(check_for_complete_lines(&clears[i % NB_CLEARS])));
+
+    /* Lines are removed from a copy of the board, timed on its own first */
+    static Game scratch;
+
+    BENCH("board copy", 1000000, 1, {
+        scratch.board = clears[i % NB_CLEARS].board;
+        KEEP(&scratch);
+    });
+
+    BENCH("board copy + remove_line", 1000000, 1, {
+        const Game* game = &clears[i % NB_CLEARS];
+
+        scratch.board = game->board;
+
+        for (int j = 0; j < game->nb_completed_lines; ++j)
+            remove_line(&scratch, game->completed_lines[j]);
+
+        KEEP(&scratch);
+    });
+
+    BENCH("board copy + remove_lines", 1000000, 1, {
+        const Game* game = &clears[i % NB_CLEARS];
+
+        scratch.board = game->board;
+        remove_lines(&scratch, game->completed_lines, game->nb_completed_lines);
+        KEEP(&scratch);
+    });
+
+    scratch = frames[0];
+
+    BENCH("get_new_tetrimino", 4000000, 1, {
+        randomizer_step(&scratch.randomizer);
+        get_new_tetrimino(&scratch);
+        KEEP(&scratch);
+    });
+
+    scratch = frames[0];
+
+    BENCH("game_step (no input)", 4000000, 1, {
+        if (scratch.state == GAME_STATE_OVER)
+            scratch = frames[0];
+
+        KEEP(game_step(&scratch, INPUT_NONE));
+    });
+}
+
+/* The frames where a piece spawns, at the gravity of a level */
+int spawn_frames_at_level(Game games[NB_FRAMES], int level)
+{
+    int nb_games = 0;
+
+    for (int i = 1; i < NB_FRAMES; ++i) {
+        if (frames[i].state != GAME_STATE_FALLING || frames[i - 1].state == GAME_STATE_FALLING)
+            continue;
+
+        Game* game = &games[nb_games++];
+
+        *game = frames[i];
+        game->level = level;
+        game->fall_rate = new_fall_rate(level);
+    }
+
+    return nb_games;
+}
+
+void bench_path()
+{
+    static PathSearch search;
+    static Game games[NB_FRAMES];
+    static Placement placements[PATH_NB_POSITIONS];
+    static const int levels[] = {0, 19, 29};
+
+    printf("\nPaths to every place of a piece which just spawned\n");
+
+    for (unsigned int l = 0; l < sizeof(levels) / sizeof(levels[0]); ++l) {
+        int nb_games = spawn_frames_at_level(games, levels[l]);
+        char name[64];
+
+        snprintf(name, sizeof(name), "path_search, level %d", levels[l]);
+        BENCH(name, 2000, 1, KEEP(path_search(&search, &games[i % nb_games])));
+    }
+
+    int nb_games = spawn_frames_at_level(games, 19);
+    long nb_ends = 0;
+    long nb_naive = 0;
+
+    BENCH("ai_choose_placement", 2000, 1, {
+        Placement best;
+        KEEP(ai_choose_placement(&games[i % nb_games], &ai_default_weights, &best));
+    });
+
+    BENCH("hint, search + choose among ends", 2000, 1, {
+        const Game* game = &games[i % nb_games];
+        int nb_placements = path_search(&search, game);
+
+        for (int j = 0; j < nb_placements; ++j)
+            placements[j] = search.ends[j].placement;
+
+        KEEP(ai_choose_among(game, &ai_default_weights, placements, nb_placements));
+    });
+
+    for (int i = 0; i < nb_games; ++i) {
+        nb_ends += path_search(&search, &games[i]);
+        nb_naive += ai_generate_placements(games[i].board.rows, &games[i].ctetr, placements);
+    }
+
+    printf("  Places found at level 19: %.1f per piece, %.1f by dropping straight down\n",
+           (double)nb_ends / nb_games, (double)nb_naive / nb_games);
+}
+
+/* Bytes written to the file of fd so far */
+long output_size(int fd)
+{
+    struct stat st;
+    return (fstat(fd, &st) == 0) ? st.st_size : 0;
+}
+
+void bench_render(FILE* ncurses_out)
+{
+    printf("\nRendering (%dx%d cells)\n", WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    cells_per_op = WINDOW_WIDTH * WINDOW_HEIGHT;
+    BENCH("board, one pass per color", 2000, 1, display_cells_by_color(boards[i % NB_BOARDS]));
+    BENCH("board, single pass, color runs", 2000, 1, display_cells_by_run(boards[i % NB_BOARDS]));
+    cells_per_op = 0;
+
+    BENCH("draw_game, full frame", 2000, 1, {
+        invalidate_screen();
+        draw_game(&frames[i % NB_FRAMES], 0);
+    });
+
+    BENCH("draw_game, consecutive frames", 20000, 1, draw_game(&frames[i % NB_FRAMES], 0));
+
+    FILE* ansi_out = tmpfile();
+
+    if (ansi_out == NULL || !ansi_init(fileno(ansi_out))) {
+        fprintf(stderr, "Could not create a file to draw on\n");
+        exit(1);
+    }
+
+    BENCH("ansi_draw_game, full frame", 2000, 1, {
+        ansi_invalidate();
+        ansi_draw_game(&frames[i % NB_FRAMES], 0);
+    });
+
+    BENCH("ansi_draw_game, consecutive frames", 20000, 1,
+          ansi_draw_game(&frames[i % NB_FRAMES], 0));
+
+    /* What a game sends to the terminal */
+    fflush(ncurses_out);
+    long ncurses_start = output_size(fileno(ncurses_out));
+
+    for (int i = 0; i < NB_FRAMES; ++i)
+        draw_game(&frames[i], 0);
+
+    fflush(ncurses_out);
+    long ncurses_bytes = output_size(fileno(ncurses_out)) - ncurses_start;
+
+    ansi_stats = (AnsiStats){0};
+
+    for (int i = 0; i < NB_FRAMES; ++i)
+        ansi_draw_game(&frames[i], 0);
+
+    printf("  Output of %d consecutive frames: ncurses %.1f bytes/frame, "
+           "ansi %.1f bytes/frame in %.2f writes\n", NB_FRAMES,
+           (double)ncurses_bytes / NB_FRAMES, (double)ansi_stats.nb_bytes / NB_FRAMES,
+           (double)ansi_stats.nb_writes / NB_FRAMES);
+
+    ansi_deinit();
+    fclose(ansi_out);
+}
+
+void bench_eval()
+{
+    EvalBatch batch;
+    EvalFeatures features;
+
+    generate_batch(&batch);
+
+    printf("\nBoard evaluation (batches of %d boards, per board)\n", EVAL_BATCH_SIZE);
+
+    for (EvalKernel kernel = 0; kernel < EVAL_NB_KERNELS; ++kernel) {
+        if (!eval_kernel_is_supported(kernel))
+            continue;
+
+        BENCH(eval_kernel_names[kernel], 20000, batch.nb_boards, {
+            eval_batch_features(&batch, &features, kernel);
+            KEEP(&features);
+        });
+    }
+}
+
+int main()
+{
+    FILE* out = tmpfile();
+    FILE* null_in = fopen("/dev/null", "r");
+
+    SCREEN* screen = newterm(getenv("TERM") ? NULL : "xterm", out, null_in);
+
+    if (screen == NULL) {
+        fprintf(stderr, "Could not create a terminal to draw on\n");
+        return 1;
+    }
+
+    set_term(screen);
+    init_windows();
+    generate_boards();
+    generate_game_data();
+
+    bench_core();
+    bench_path();
+    bench_render(out);
+    bench_eval();
+
+    endwin();
+    delscreen(screen);
+    fclose(out);
+    fclose(null_in);
+
+    return 0;
+}
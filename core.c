@@ -0,0 +1,498 @@
+#include "core.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Possible shapes of all tetriminos given a rotation angle, as the (dx, dy)
+ * offsets of their 4 blocks. This list is expanded into both the shapes and
+ * the shape_masks tables.
+ */
+#define SHAPES(SHAPE) \
+    /* angle 0 -- facing down */ \
+    SHAPE(-2,  0, -1,  0,  0,  0,  1,  0)  /*  0 : I */ \
+    SHAPE(-1,  0,  0,  0, -1,  1,  0,  1)  /*  1 : O */ \
+    SHAPE(-1,  0,  0,  0,  1,  0,  0,  1)  /*  2 : T */ \
+    SHAPE(-1,  0,  0,  0,  1,  0, -1,  1)  /*  3 : L */ \
+    SHAPE(-1,  0,  0,  0,  1,  0,  1,  1)  /*  4 : J */ \
+    SHAPE(-1,  0,  0,  0,  0,  1,  1,  1)  /*  5 : Z */ \
+    SHAPE( 0,  0,  1,  0, -1,  1,  0,  1)  /*  6 : S */ \
+    \
+    /* angle 1 -- facing left */ \
+    SHAPE( 0, -2,  0, -1,  0,  0,  0,  1)  /*  7 : I */ \
+    SHAPE(-1,  0,  0,  0, -1,  1,  0,  1)  /*  8 : O */ \
+    SHAPE( 0, -1, -1,  0,  0,  0,  0,  1)  /*  9 : T */ \
+    SHAPE(-1, -1,  0, -1,  0,  0,  0,  1)  /* 10 : L */ \
+    SHAPE( 0, -1,  0,  0, -1,  1,  0,  1)  /* 11 : J */ \
+    SHAPE( 1, -1,  0,  0,  1,  0,  0,  1)  /* 12 : Z */ \
+    SHAPE( 0, -1,  0,  0,  1,  0,  1,  1)  /* 13 : S */ \
+    \
+    /* angle 2 -- facing up */ \
+    SHAPE(-2,  0, -1,  0,  0,  0,  1,  0)  /* 14 : I */ \
+    SHAPE(-1,  0,  0,  0, -1,  1,  0,  1)  /* 15 : O */ \
+    SHAPE(-1,  0,  0,  0,  1,  0,  0, -1)  /* 16 : T */ \
+    SHAPE( 1, -1, -1,  0,  0,  0,  1,  0)  /* 17 : L */ \
+    SHAPE(-1, -1, -1,  0,  0,  0,  1,  0)  /* 18 : J */ \
+    SHAPE(-1,  0,  0,  0,  0,  1,  1,  1)  /* 19 : Z */ \
+    SHAPE( 0,  0,  1,  0, -1,  1,  0,  1)  /* 20 : S */ \
+    \
+    /* angle 3 -- facing right */ \
+    SHAPE( 0, -2,  0, -1,  0,  0,  0,  1)  /* 21 : I */ \
+    SHAPE(-1,  0,  0,  0, -1,  1,  0,  1)  /* 22 : O */ \
+    SHAPE( 0, -1,  0,  0,  1,  0,  0,  1)  /* 23 : T */ \
+    SHAPE( 0, -1,  0,  0,  0,  1,  1,  1)  /* 24 : L */ \
+    SHAPE( 0, -1,  1, -1,  0,  0,  0,  1)  /* 25 : J */ \
+    SHAPE( 1, -1,  0,  0,  1,  0,  0,  1)  /* 26 : Z */ \
+    SHAPE( 0, -1,  0,  0,  1,  0,  1,  1)  /* 27 : S */
+
+#define SHAPE_CELLS(x0, y0, x1, y1, x2, y2, x3, y3) \
+    {{x0, y0}, {x1, y1}, {x2, y2}, {x3, y3}},
+
+#define CELL_MASK(x, y) ((RowWindow)1 << (ROW_BITS * ((y) + 2) + (x) + 2))
+
+#define SHAPE_MASK(x0, y0, x1, y1, x2, y2, x3, y3) \
+    CELL_MASK(x0, y0) | CELL_MASK(x1, y1) | CELL_MASK(x2, y2) | CELL_MASK(x3, y3),
+
+const char shapes[28][4][2] = { SHAPES(SHAPE_CELLS) };
+
+const RowWindow shape_masks[28] = { SHAPES(SHAPE_MASK) };
+
+const uint8_t spawn_ids[7] = {
+    0x02, // T
+    0x07, // J
+    0x08, // Z
+    0x0A, // O
+    0x0B, // S
+    0x0E, // L
+    0x12, // I
+};
+
+const BlockType spawn_types[7] = {
+    BLOCK_TYPE_T,
+    BLOCK_TYPE_J,
+    BLOCK_TYPE_Z,
+    BLOCK_TYPE_O,
+    BLOCK_TYPE_S,
+    BLOCK_TYPE_L,
+    BLOCK_TYPE_I,
+};
+
+static int max(int a, int b)
+{
+    return (a > b) ? a : b;
+}
+
+static int min(int a, int b)
+{
+    return (a < b) ? a : b;
+}
+
+// @Optim : precompute this
+int get_shape_nb(BlockType type, int angle)
+{
+    return (type - 1) + 7 * angle;
+}
+
+void randomizer_init(Randomizer* randomizer, uint16_t seed)
+{
+    randomizer->seed = (seed != 0) ? seed : RANDOMIZER_DEFAULT_SEED;
+    randomizer->spawn_count = 0;
+    randomizer->spawn_id = 0;
+}
+
+void game_init(Game* game, int start_level, uint16_t seed)
+{
+    memset(game, 0, sizeof(*game));
+    board_init(&game->board);
+
+    game->start_level = start_level;
+    game->level = start_level;
+    game->fall_rate = new_fall_rate(game->level);
+
+    /* For the starting level, this is the formula to get the lines to be
+     * cleared before getting to the next one. After that, a new level is
+     * reached after clearing 10 lines. See https://tetris.wiki/Scoring
+     */
+    game->lines_before_next_level = min(10 * start_level + 10, max(100, 10 * start_level - 50));
+
+    // @Hack : This starts at one so the game doesn't update right away
+    game->nb_frames = 1;
+
+    randomizer_init(&game->randomizer, seed);
+    game->seed = game->randomizer.seed;
+
+    /* Initialize the tetriminos */
+    game->ntetr = make_new_tetrimino(randomizer_next_piece(&game->randomizer));
+    get_new_tetrimino(game);
+}
+
+void board_init(Board* board)
+{
+    for (int i = 0; i < BOARD_ROWS; ++i)
+        board->rows[i] = (i < BOARD_TOP + WINDOW_HEIGHT) ? EMPTY_ROW : FULL_ROW;
+
+    memset(board->colors, BLOCK_TYPE_NONE, sizeof(board->colors));
+}
+
+int rows_clear_lines(BoardRow rows[BOARD_ROWS])
+{
+    int to = BOARD_TOP + WINDOW_HEIGHT - 1;
+
+    for (int from = to; from >= 0; --from)
+        if (rows[from] != FULL_ROW)
+            rows[to--] = rows[from];
+
+    int nb_cleared = to + 1;
+
+    while (to >= 0)
+        rows[to--] = EMPTY_ROW;
+
+    return nb_cleared;
+}
+
+Tetrimino make_new_tetrimino(BlockType type)
+{
+    Tetrimino t;
+
+    t.type = type;
+    t.angle = 0;
+
+    t.x = WINDOW_WIDTH / 2;
+    t.y = 0;
+
+    t.shape_number = get_shape_nb(t.type, t.angle);
+
+    return t;
+}
+
+/* Use the same random generator as NES Tetris */
+void get_new_tetrimino(Game* game)
+{
+    game->ctetr = game->ntetr;
+    game->ntetr = make_new_tetrimino(randomizer_next_piece(&game->randomizer));
+}
+
+bool shape_can_fit(const Game* game, int tx, int ty, int shape_number)
+{
+    return board_can_fit(&game->board, tx, ty, shape_number);
+}
+
+void rotate_tetrimino(Game* game, int angle)
+{
+    Tetrimino* ctetr = &game->ctetr;
+
+    // C modulos really are great
+    if (angle == -1)
+        angle = 3;
+
+    assert(angle >= 0);
+
+    int new_angle = (ctetr->angle + angle) % 4;
+    int new_shape_nb = get_shape_nb(ctetr->type, new_angle);
+
+    if (shape_can_fit(game, ctetr->x, ctetr->y, new_shape_nb)) {
+        ctetr->angle = new_angle;
+        ctetr->shape_number = new_shape_nb;
+    }
+}
+
+/* Returns the height of the locked piece (used for the entry delay) */
+int add_blocks_to_board(Game* game)
+{
+    const Tetrimino* ctetr = &game->ctetr;
+    int height = WINDOW_HEIGHT;
+
+    for (int i = 0; i < 4; ++i) {
+        int x = ctetr->x + shapes[ctetr->shape_number][i][0];
+        int y = ctetr->y + shapes[ctetr->shape_number][i][1];
+
+        board_set(&game->board, x, y, ctetr->type);
+
+        // "height" will be the minimum y value
+        if (y < height)
+            height = y;
+    }
+
+    return height;
+}
+
+bool line_is_complete(const Game* game, int i)
+{
+    return board_row(&game->board, i) == FULL_ROW;
+}
+
+/* Shift every row above i down by one, the vanishing zone included */
+void remove_line(Game* game, int i)
+{
+    Board* board = &game->board;
+
+    memmove(&board->rows[1], &board->rows[0], (BOARD_TOP + i) * sizeof(board->rows[0]));
+    memmove(&board->colors[1], &board->colors[0], (BOARD_TOP + i) * sizeof(board->colors[0]));
+
+    board->rows[0] = EMPTY_ROW;
+    memset(board->colors[0], BLOCK_TYPE_NONE, sizeof(board->colors[0]));
+}
+
+static int score_factor(int nb_completed_lines)
+{
+    switch (nb_completed_lines)
+    {
+        case 0: return 0;
+        case 1: return 40;
+        case 2: return 100;
+        case 3: return 300;
+        case 4: return 1200;
+    }
+
+    assert(0 && "Impossible number of lines cleared");
+    return 0;
+}
+
+/*
+ * Returns the number of completed lines, which are not removed yet. Only the
+ * rows of the piece which was just locked can have been completed.
+ */
+int check_for_complete_lines(Game* game)
+{
+    const Tetrimino* ctetr = &game->ctetr;
+    RowWindow shape = shape_masks[ctetr->shape_number];
+
+    game->nb_completed_lines = 0;
+
+    for (int dy = -2; dy <= 1; ++dy) {
+        int i = ctetr->y + dy;
+
+        /* The floor is complete too, but never under a block of the shape */
+        if ((BoardRow)(shape >> (ROW_BITS * (dy + 2))) && line_is_complete(game, i)) {
+            game->completed_lines[game->nb_completed_lines] = i;
+            ++game->nb_completed_lines;
+        }
+    }
+
+    return game->nb_completed_lines;
+}
+
+/*
+ * Remove all the complete lines in a single pass. The rows between two lines
+ * move down together, from the lowest ones up, so each row is moved at most
+ * once. The lines must be sorted.
+ */
+void remove_lines(Game* game, const int lines[], int nb_lines)
+{
+    Board* board = &game->board;
+
+    for (int i = nb_lines - 1; i >= 0; --i) {
+        int shift = nb_lines - i;
+        int top = (i > 0) ? BOARD_TOP + lines[i - 1] + 1 : 0;
+        int nb_rows = BOARD_TOP + lines[i] - top;
+
+        memmove(&board->rows[top + shift], &board->rows[top], nb_rows * sizeof(board->rows[0]));
+        memmove(&board->colors[top + shift], &board->colors[top], nb_rows * sizeof(board->colors[0]));
+    }
+
+    for (int y = 0; y < nb_lines; ++y)
+        board->rows[y] = EMPTY_ROW;
+
+    memset(board->colors, BLOCK_TYPE_NONE, nb_lines * sizeof(board->colors[0]));
+}
+
+void clear_complete_lines(Game* game)
+{
+    remove_lines(game, game->completed_lines, game->nb_completed_lines);
+
+    game->score += (game->level + 1) * score_factor(game->nb_completed_lines);
+    game->cleared_lines += game->nb_completed_lines;
+    game->nb_completed_lines = 0;
+
+    /* Update the level if needed */
+    if (game->cleared_lines >= game->lines_before_next_level) {
+        ++game->level;
+        game->lines_before_next_level += 10;
+        game->fall_rate = new_fall_rate(game->level);
+    }
+}
+
+// See https://tetris.wiki/Tetris_(NES,_Nintendo) for the ARE formula used,
+// counted from the floor so taller boards keep the same range of delays
+int entry_delay(int piece_height)
+{
+    return min(18, 10 + 2 * ((WINDOW_HEIGHT - 1 - piece_height) / 4));
+}
+
+/* If the new piece (ctetr) can't fit, it's game over (block out) */
+void check_for_game_over(Game* game)
+{
+    const Tetrimino* ctetr = &game->ctetr;
+
+    if (!shape_can_fit(game, ctetr->x, ctetr->y, ctetr->shape_number))
+        game->state = GAME_STATE_OVER;
+}
+
+bool can_move_down(const Game* game)
+{
+    const Tetrimino* ctetr = &game->ctetr;
+
+    return shape_can_fit(game, ctetr->x, ctetr->y + 1, ctetr->shape_number);
+}
+
+bool can_move_right(const Game* game)
+{
+    const Tetrimino* ctetr = &game->ctetr;
+
+    return shape_can_fit(game, ctetr->x + 1, ctetr->y, ctetr->shape_number);
+}
+
+bool can_move_left(const Game* game)
+{
+    const Tetrimino* ctetr = &game->ctetr;
+
+    return shape_can_fit(game, ctetr->x - 1, ctetr->y, ctetr->shape_number);
+}
+
+int new_fall_rate(int level)
+{
+    switch (level) {
+        case 0: return 48;
+        case 1: return 43;
+        case 2: return 38;
+        case 3: return 33;
+        case 4: return 28;
+        case 5: return 23;
+        case 6: return 18;
+        case 7: return 13;
+        case 8: return 8;
+        case 9: return 6;
+
+        case 10:
+        case 11:
+        case 12:
+            return 5;
+
+        case 13:
+        case 14:
+        case 15:
+            return 4;
+
+        case 16:
+        case 17:
+        case 18:
+            return 3;
+    }
+
+    if (level >= 19 && level <= 28)
+        return 2;
+    else if (level >= 29)
+        return 1;
+
+    assert(0 && "Impossible level value");
+    return 48;
+}
+
+/* The locked piece has no block in the visible field */
+static bool is_locked_out(const Game* game)
+{
+    const Tetrimino* ctetr = &game->ctetr;
+
+    for (int i = 0; i < 4; ++i)
+        if (ctetr->y + shapes[ctetr->shape_number][i][1] >= 0)
+            return false;
+
+    return true;
+}
+
+static void start_entry_delay(Game* game)
+{
+    game->state = GAME_STATE_ENTRY_DELAY;
+    game->state_frames = entry_delay(game->piece_height);
+}
+
+/* Returns true if the piece was locked */
+static bool apply_gravity(Game* game)
+{
+    if (can_move_down(game)) {
+        ++game->ctetr.y;
+        return false;
+    }
+
+    game->piece_height = add_blocks_to_board(game);
+    ++game->nb_pieces;
+
+    if (is_locked_out(game)) {
+        game->state = GAME_STATE_OVER;
+    } else if (check_for_complete_lines(game) > 0) {
+        /* Freeze for 20 frames */
+        game->state = GAME_STATE_LINE_CLEAR;
+        game->state_frames = 20;
+    } else {
+        start_entry_delay(game);
+    }
+
+    return true;
+}
+
+static void apply_input(Game* game, Input input)
+{
+    Tetrimino* ctetr = &game->ctetr;
+
+    if ((input & INPUT_LEFT) && can_move_left(game))
+        --ctetr->x;
+
+    if ((input & INPUT_RIGHT) && can_move_right(game))
+        ++ctetr->x;
+
+    if ((input & INPUT_DOWN) && can_move_down(game)) {
+        ++ctetr->y;
+
+        /* Reset the timer when the tetrimino is about to be dropped as
+         * to give the player a last chance to place it correctly
+         * without any timer luck involved */
+        if (!can_move_down(game))
+            game->nb_frames = 0;
+    }
+
+    if (input & INPUT_ROTATE_CW)
+        rotate_tetrimino(game, 1);
+
+    if (input & INPUT_ROTATE_CCW)
+        rotate_tetrimino(game, -1);
+}
+
+bool game_step(Game* game, Input input)
+{
+    randomizer_step(&game->randomizer);
+
+    switch (game->state) {
+        case GAME_STATE_FALLING:
+            if (game->nb_frames % game->fall_rate == 0 && apply_gravity(game))
+                return true;
+
+            apply_input(game, input);
+            ++game->nb_frames;
+            break;
+
+        case GAME_STATE_LINE_CLEAR:
+            if (--game->state_frames == 0) {
+                clear_complete_lines(game);
+                start_entry_delay(game);
+            }
+            break;
+
+        case GAME_STATE_ENTRY_DELAY:
+            if (--game->state_frames == 0) {
+                get_new_tetrimino(game);
+                game->state = GAME_STATE_FALLING;
+
+                /* Like the first one, a new piece waits a whole fall_rate
+                 * before gravity pulls it down */
+                game->nb_frames = 1;
+                check_for_game_over(game);
+            }
+            break;
+
+        case GAME_STATE_OVER:
+            break;
+    }
+
+    return false;
+}
@@ -0,0 +1,343 @@
+#ifndef CORE_H
+#define CORE_H
+
+/*
+ * Game rules, without any dependency on ncurses or on the wall clock.
+ *
+ * Everything needed to run a game lives in a Game struct, so any number of
+ * games can be simulated at once and as fast as the CPU allows. A front end
+ * only has to feed one Input per frame to game_step and draw the result.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Size of the board. It can be changed when building (make BOARD_WIDTH=12
+ * BOARD_HEIGHT=40), and everything is then compiled for that size, so loops
+ * over the board keep constant bounds whatever it is.
+ */
+#ifndef WINDOW_WIDTH
+#define WINDOW_WIDTH 10
+#endif
+
+#ifndef WINDOW_HEIGHT
+#define WINDOW_HEIGHT 20
+#endif
+
+typedef enum BlockType {
+    BLOCK_TYPE_NONE = 0,
+    BLOCK_TYPE_I    = 1,
+    BLOCK_TYPE_O    = 2,
+    BLOCK_TYPE_T    = 3,
+    BLOCK_TYPE_L    = 4,
+    BLOCK_TYPE_J    = 5,
+    BLOCK_TYPE_Z    = 6,
+    BLOCK_TYPE_S    = 7,
+} BlockType;
+
+/* Buttons pressed during a frame, several of them can be combined */
+typedef enum Input {
+    INPUT_NONE         = 0,
+    INPUT_LEFT         = 1 << 0,
+    INPUT_RIGHT        = 1 << 1,
+    INPUT_DOWN         = 1 << 2,
+    INPUT_ROTATE_CW    = 1 << 3,
+    INPUT_ROTATE_CCW   = 1 << 4,
+} Input;
+
+/*
+ * The piece generator of NES Tetris: a 16-bit linear feedback shift register
+ * and the "reroll once" rule to limit repeated pieces. See
+ * https://meatfighter.com/nintendotetrisai/#Picking_Tetriminos
+ *
+ * It only depends on its seed, so the same seed always gives the same sequence
+ * whatever the platform.
+ */
+typedef struct Randomizer {
+    uint16_t seed;
+
+    /* Number of pieces picked so far, wrapping like the NES byte */
+    uint8_t spawn_count;
+
+    /* Orientation id of the last picked piece, as stored by the NES */
+    uint8_t spawn_id;
+} Randomizer;
+
+/* Value of the seed when the NES is powered on */
+#define RANDOMIZER_DEFAULT_SEED 0x8988
+
+/* Orientation ids of the pieces as they spawn, in the order of the NES table */
+extern const uint8_t spawn_ids[7];
+extern const BlockType spawn_types[7];
+
+/* Advance the register, the NES does it once per frame */
+static inline void randomizer_step(Randomizer* randomizer)
+{
+    uint16_t seed = randomizer->seed;
+    uint16_t bit = ((seed >> 9) ^ (seed >> 1)) & 1;
+
+    randomizer->seed = (bit << 15) | (seed >> 1);
+}
+
+static inline BlockType randomizer_next_piece(Randomizer* randomizer)
+{
+    ++randomizer->spawn_count;
+
+    unsigned int index = ((randomizer->seed >> 8) + randomizer->spawn_count) & 7;
+
+    /* Reroll once if the index is invalid or gives the same piece again. The
+     * NES adds the orientation id here, not the index */
+    if (index == 7 || spawn_ids[index] == randomizer->spawn_id) {
+        randomizer_step(randomizer);
+        index = (((randomizer->seed >> 8) & 7) + randomizer->spawn_id) % 7;
+    }
+
+    randomizer->spawn_id = spawn_ids[index];
+
+    return spawn_types[index];
+}
+
+/* A seed of 0 would keep the register at 0 forever, the default seed is used
+ * instead */
+void randomizer_init(Randomizer* randomizer, uint16_t seed);
+
+typedef enum GameState {
+    /* The player controls the current tetrimino */
+    GAME_STATE_FALLING,
+
+    /* The completed lines flash before being removed */
+    GAME_STATE_LINE_CLEAR,
+
+    /* Waiting for the next tetrimino to spawn (ARE) */
+    GAME_STATE_ENTRY_DELAY,
+
+    GAME_STATE_OVER,
+} GameState;
+
+typedef struct Tetrimino {
+    /* Position of the tetrimino */
+    int x;
+    int y;
+
+    /* Rotation angle, from 0 to 3 */
+    int angle;
+
+    /* Type can be either I, O, T, L, J, Z or S */
+    BlockType type;
+
+    /* Combination of type and angle, id of the shape in the shapes array */
+    int shape_number;
+} Tetrimino;
+
+/*
+ * Rows are padded with wall columns on both sides, and the board with rows
+ * above and below the visible field, so a piece going out of the board simply
+ * collides with them like it would with any other block.
+ *
+ * The BOARD_TOP rows above the field are a hidden vanishing zone, from y = -1
+ * up. Blocks locked there are kept like any other, so nothing needs to check
+ * for negative rows. A piece locked entirely in it ends the game (lock out),
+ * as does a new piece which doesn't fit (block out).
+ */
+#define WALL_WIDTH 3
+#define BOARD_TOP 2
+#define BOARD_FLOOR 2
+#define BOARD_ROWS (BOARD_TOP + WINDOW_HEIGHT + BOARD_FLOOR)
+
+#if WINDOW_WIDTH < 4 || WINDOW_HEIGHT < 4
+#error "The board is too small for the tetriminos"
+#endif
+
+#if WINDOW_HEIGHT > 255
+#error "The board is too tall for the replays"
+#endif
+
+/*
+ * Rows are as small as the board allows, 16 bits for the usual 10 columns.
+ * A window of 4 rows, where shapes are tested, holds in a single integer.
+ */
+#if 2 * WALL_WIDTH + WINDOW_WIDTH <= 16
+#define ROW_BITS 16
+typedef uint16_t BoardRow;
+typedef uint64_t RowWindow;
+#elif 2 * WALL_WIDTH + WINDOW_WIDTH <= 32
+#define ROW_BITS 32
+typedef uint32_t BoardRow;
+typedef unsigned __int128 RowWindow;
+#else
+#error "The board is too wide to fit in 32-bit rows"
+#endif
+
+/* A row where every cell is occupied */
+#define FULL_ROW ((BoardRow)~(BoardRow)0)
+
+/* A row where only the walls are set */
+#define EMPTY_ROW ((BoardRow)~((((BoardRow)1 << WINDOW_WIDTH) - 1) << WALL_WIDTH))
+
+/*
+ * The board is stored row by row. Each row is an occupancy mask where bit
+ * WALL_WIDTH + x is set if the cell (x, y) is occupied, so checking or clearing
+ * a line only touches a single word. The types of the blocks are kept apart in
+ * a color plane which is only needed for rendering.
+ */
+typedef struct Board {
+    BoardRow rows[BOARD_ROWS];
+
+    /* Including the vanishing zone, so the field starts at colors[BOARD_TOP] */
+    unsigned char colors[BOARD_TOP + WINDOW_HEIGHT][WINDOW_WIDTH];
+} Board;
+
+/*
+ * Possible shapes of all tetriminos as 4 rows of ROW_BITS bits, from dy = -2
+ * to dy = 1, where bit dx + 2 of a row is set if the shape has a block there.
+ * Generated at compile time from the shapes table.
+ */
+extern const RowWindow shape_masks[28];
+
+static inline BoardRow board_row(const Board* board, int y)
+{
+    return board->rows[BOARD_TOP + y];
+}
+
+static inline bool board_is_occupied(const Board* board, int x, int y)
+{
+    return board_row(board, y) & ((BoardRow)1 << (WALL_WIDTH + x));
+}
+
+static inline BlockType board_get(const Board* board, int x, int y)
+{
+    return board->colors[BOARD_TOP + y][x];
+}
+
+static inline void board_set(Board* board, int x, int y, BlockType type)
+{
+    board->rows[BOARD_TOP + y] |= (BoardRow)1 << (WALL_WIDTH + x);
+    board->colors[BOARD_TOP + y][x] = type;
+}
+
+/*
+ * The functions below work on the occupancy rows alone, without the color
+ * plane, for code which simulates many placements like the AI.
+ */
+
+/* The 4 rows a shape placed at height y can cover, packed like shape_masks */
+static inline RowWindow rows_window(const BoardRow rows[BOARD_ROWS], int y)
+{
+    const BoardRow* window = &rows[BOARD_TOP + y - 2];
+
+    return (RowWindow)window[0]
+        | (RowWindow)window[1] << ROW_BITS
+        | (RowWindow)window[2] << (2 * ROW_BITS)
+        | (RowWindow)window[3] << (3 * ROW_BITS);
+}
+
+static inline RowWindow shape_mask_at(int x, int shape_number)
+{
+    return shape_masks[shape_number] << (WALL_WIDTH - 2 + x);
+}
+
+/* Only valid for 0 <= y <= WINDOW_HEIGHT, which covers every move of a piece */
+static inline bool rows_can_fit(const BoardRow rows[BOARD_ROWS], int x, int y, int shape_number)
+{
+    return !(rows_window(rows, y) & shape_mask_at(x, shape_number));
+}
+
+/* Set the occupancy bits of a shape, including the ones above the board */
+static inline void rows_add_shape(BoardRow rows[BOARD_ROWS], int x, int y, int shape_number)
+{
+    RowWindow shape = shape_mask_at(x, shape_number);
+    BoardRow* window = &rows[BOARD_TOP + y - 2];
+
+    for (int i = 0; i < 4; ++i)
+        window[i] |= (BoardRow)(shape >> (ROW_BITS * i));
+}
+
+/* Remove all complete lines at once. Returns the number of lines removed */
+int rows_clear_lines(BoardRow rows[BOARD_ROWS]);
+
+static inline bool board_can_fit(const Board* board, int x, int y, int shape_number)
+{
+    return rows_can_fit(board->rows, x, y, shape_number);
+}
+
+void board_init(Board* board);
+
+typedef struct Game {
+    Board board;
+
+    /* The tetrimino currently controlled by the player */
+    Tetrimino ctetr;
+
+    /* The tetrimino available next */
+    Tetrimino ntetr;
+
+    long score;
+
+    int level;
+    int start_level;
+    int lines_before_next_level;
+    int cleared_lines;
+
+    /* Number of tetriminos locked so far */
+    long nb_pieces;
+
+    /* Tetrimino's position will be updated once every fall_rate frame */
+    int fall_rate;
+
+    int nb_frames;
+
+    GameState state;
+
+    /* Frames left before leaving the line clear or entry delay state */
+    int state_frames;
+
+    Randomizer randomizer;
+
+    /* The seed the game started with, enough to get the same pieces again */
+    uint16_t seed;
+
+    /* Lines completed by the last lock, still on the board while in the line
+     * clear state. Lines of the vanishing zone are negative */
+    int nb_completed_lines;
+    int completed_lines[4];
+    int piece_height;
+} Game;
+
+/* Possible shapes of all tetriminos given a rotation angle */
+extern const char shapes[28][4][2];
+
+int get_shape_nb(BlockType type, int angle);
+
+void game_init(Game* game, int start_level, uint16_t seed);
+
+/*
+ * Advance the game by one frame. Returns true if a piece was locked.
+ * Inputs are ignored outside of the falling state, like on the NES.
+ */
+bool game_step(Game* game, Input input);
+
+Tetrimino make_new_tetrimino(BlockType type);
+void get_new_tetrimino(Game* game);
+
+bool shape_can_fit(const Game* game, int tx, int ty, int shape_number);
+void rotate_tetrimino(Game* game, int angle);
+
+int add_blocks_to_board(Game* game);
+bool line_is_complete(const Game* game, int i);
+void remove_line(Game* game, int i);
+void remove_lines(Game* game, const int lines[], int nb_lines);
+int check_for_complete_lines(Game* game);
+void clear_complete_lines(Game* game);
+void check_for_game_over(Game* game);
+
+bool can_move_down(const Game* game);
+bool can_move_right(const Game* game);
+bool can_move_left(const Game* game);
+
+int new_fall_rate(int level);
+
+/* Frames to wait before the next piece spawns */
+int entry_delay(int piece_height);
+
+#endif
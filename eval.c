@@ -0,0 +1,355 @@
+#include "eval.h"
+
+/* The vector kernels take one board per 16-bit lane */
+#if (defined(__x86_64__) || defined(__i386__)) && ROW_BITS == 16
+#define HAS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+const char* const eval_kernel_names[EVAL_NB_KERNELS] = {
+    [EVAL_KERNEL_SCALAR] = "scalar",
+    [EVAL_KERNEL_SSE2] = "sse2",
+    [EVAL_KERNEL_AVX2] = "avx2",
+};
+
+/* The playable columns of a row */
+#define INTERIOR ((BoardRow)~EMPTY_ROW)
+
+/* Bits of the columns which have a right neighbour in the board */
+#define PAIRS ((BoardRow)(INTERIOR & (INTERIOR >> 1)))
+
+/* Same, with the walls next to the board as neighbours */
+#define WALL_PAIRS ((BoardRow)(INTERIOR | (INTERIOR >> 1)))
+
+/*
+ * Bits set in a row. __builtin_popcount is a call into libgcc without
+ * -mpopcnt, which the build doesn't assume, so the bits are added up in
+ * parallel instead, like the vector kernels do.
+ */
+static inline int row_popcount(BoardRow row)
+{
+    uint32_t x = row;
+
+    x -= (x >> 1) & 0x55555555;
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    x = (x + (x >> 4)) & 0x0F0F0F0F;
+
+    return (x * 0x01010101) >> 24;
+}
+
+/*
+ * All features are computed a row at a time from the top, with "covered"
+ * holding the columns which have a block in this row or above it:
+ * - the height of a column is the number of rows where it is covered,
+ * - a hole is an empty cell in a covered column,
+ * - two adjacent columns differ in height by the number of rows where only
+ *   one of them is covered,
+ * - a row transition is a pair of adjacent cells where only one is occupied,
+ * - a well is an empty cell in an uncovered column between two occupied ones.
+ */
+void eval_board_features(const BoardRow rows[BOARD_ROWS], BoardFeatures* features)
+{
+    BoardRow covered = 0;
+    BoardRow lost = 0;
+
+    *features = (BoardFeatures) {0};
+
+    for (int y = 0; y < BOARD_TOP; ++y)
+        lost |= rows[y] & INTERIOR;
+
+    for (int y = BOARD_TOP; y < EVAL_ROWS; ++y) {
+        BoardRow row = rows[y] & INTERIOR;
+
+        features->holes += row_popcount(covered & ~row);
+        covered |= row;
+        features->height += row_popcount(covered);
+        features->bumpiness += row_popcount((covered ^ (covered >> 1)) & PAIRS);
+        features->row_transitions += row_popcount((rows[y] ^ (rows[y] >> 1)) & WALL_PAIRS);
+        features->wells += row_popcount(~covered & (rows[y] << 1) & (rows[y] >> 1) & INTERIOR);
+    }
+
+    features->lost = lost != 0;
+}
+
+double eval_score(const BoardFeatures* features, int nb_cleared_lines, const AiWeights* weights)
+{
+    if (features->lost)
+        return AI_LOST_SCORE;
+
+    return weights->height * features->height
+        + weights->lines * nb_cleared_lines
+        + weights->holes * features->holes
+        + weights->bumpiness * features->bumpiness
+        + weights->row_transitions * features->row_transitions
+        + weights->wells * features->wells;
+}
+
+static void features_scalar(const EvalBatch* batch, EvalFeatures* features)
+{
+    for (int i = 0; i < batch->nb_boards; ++i) {
+        BoardRow rows[BOARD_ROWS];
+        BoardFeatures board;
+
+        for (int y = 0; y < EVAL_ROWS; ++y)
+            rows[y] = batch->rows[y][i];
+
+        eval_board_features(rows, &board);
+
+        features->height[i] = board.height;
+        features->holes[i] = board.holes;
+        features->bumpiness[i] = board.bumpiness;
+        features->row_transitions[i] = board.row_transitions;
+        features->wells[i] = board.wells;
+        features->lost[i] = board.lost;
+    }
+}
+
+/*
+ * The vector kernels do the same as eval_board_features, with one board per
+ * 16-bit lane. Popcounts are only taken down to a count per byte, at most 8
+ * per row, which are summed over up to BYTE_COUNT_ROWS rows without
+ * overflowing and only then folded into a count per lane, once for a board of
+ * 20 rows.
+ */
+
+#define BYTE_COUNT_ROWS 31
+
+#ifdef HAS_X86_KERNELS
+
+__attribute__((target("sse2")))
+static inline __m128i byte_popcount_sse2(__m128i x)
+{
+    const __m128i m1 = _mm_set1_epi16(0x5555);
+    const __m128i m2 = _mm_set1_epi16(0x3333);
+    const __m128i m4 = _mm_set1_epi16(0x0F0F);
+
+    x = _mm_sub_epi16(x, _mm_and_si128(_mm_srli_epi16(x, 1), m1));
+    x = _mm_add_epi16(_mm_and_si128(x, m2), _mm_and_si128(_mm_srli_epi16(x, 2), m2));
+
+    return _mm_and_si128(_mm_add_epi16(x, _mm_srli_epi16(x, 4)), m4);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i fold_bytes_sse2(__m128i x)
+{
+    return _mm_add_epi16(_mm_and_si128(x, _mm_set1_epi16(0xFF)), _mm_srli_epi16(x, 8));
+}
+
+__attribute__((target("sse2")))
+static void features_sse2(const EvalBatch* batch, EvalFeatures* features)
+{
+    const __m128i interior = _mm_set1_epi16(INTERIOR);
+    const __m128i pairs = _mm_set1_epi16(PAIRS);
+    const __m128i wall_pairs = _mm_set1_epi16(WALL_PAIRS);
+
+    for (int i = 0; i < batch->nb_boards; i += 8) {
+        __m128i covered = _mm_setzero_si128();
+        __m128i lost = _mm_setzero_si128();
+        __m128i total_height = _mm_setzero_si128();
+        __m128i total_holes = _mm_setzero_si128();
+        __m128i total_bumpiness = _mm_setzero_si128();
+        __m128i total_transitions = _mm_setzero_si128();
+        __m128i total_wells = _mm_setzero_si128();
+
+        for (int y = 0; y < BOARD_TOP; ++y) {
+            __m128i rows = _mm_loadu_si128((const __m128i*)&batch->rows[y][i]);
+            lost = _mm_or_si128(lost, _mm_and_si128(rows, interior));
+        }
+
+        for (int top = BOARD_TOP; top < EVAL_ROWS; top += BYTE_COUNT_ROWS) {
+            int bottom = (top + BYTE_COUNT_ROWS < EVAL_ROWS) ? top + BYTE_COUNT_ROWS : EVAL_ROWS;
+
+            __m128i height = _mm_setzero_si128();
+            __m128i holes = _mm_setzero_si128();
+            __m128i bumpiness = _mm_setzero_si128();
+            __m128i transitions = _mm_setzero_si128();
+            __m128i wells = _mm_setzero_si128();
+
+            for (int y = top; y < bottom; ++y) {
+                __m128i rows = _mm_loadu_si128((const __m128i*)&batch->rows[y][i]);
+                __m128i row = _mm_and_si128(rows, interior);
+
+                holes = _mm_add_epi16(holes, byte_popcount_sse2(_mm_andnot_si128(row, covered)));
+                covered = _mm_or_si128(covered, row);
+                height = _mm_add_epi16(height, byte_popcount_sse2(covered));
+
+                __m128i steps = _mm_xor_si128(covered, _mm_srli_epi16(covered, 1));
+                bumpiness = _mm_add_epi16(bumpiness, byte_popcount_sse2(_mm_and_si128(steps, pairs)));
+
+                __m128i changes = _mm_xor_si128(rows, _mm_srli_epi16(rows, 1));
+                transitions = _mm_add_epi16(transitions, byte_popcount_sse2(_mm_and_si128(changes, wall_pairs)));
+
+                __m128i walled = _mm_and_si128(_mm_slli_epi16(rows, 1), _mm_srli_epi16(rows, 1));
+                walled = _mm_andnot_si128(covered, _mm_and_si128(walled, interior));
+                wells = _mm_add_epi16(wells, byte_popcount_sse2(walled));
+            }
+
+            total_height = _mm_add_epi16(total_height, fold_bytes_sse2(height));
+            total_holes = _mm_add_epi16(total_holes, fold_bytes_sse2(holes));
+            total_bumpiness = _mm_add_epi16(total_bumpiness, fold_bytes_sse2(bumpiness));
+            total_transitions = _mm_add_epi16(total_transitions, fold_bytes_sse2(transitions));
+            total_wells = _mm_add_epi16(total_wells, fold_bytes_sse2(wells));
+        }
+
+        _mm_storeu_si128((__m128i*)&features->height[i], total_height);
+        _mm_storeu_si128((__m128i*)&features->holes[i], total_holes);
+        _mm_storeu_si128((__m128i*)&features->bumpiness[i], total_bumpiness);
+        _mm_storeu_si128((__m128i*)&features->row_transitions[i], total_transitions);
+        _mm_storeu_si128((__m128i*)&features->wells[i], total_wells);
+        _mm_storeu_si128((__m128i*)&features->lost[i], lost);
+    }
+}
+
+/* With AVX2, bytes are counted with a table of the popcount of each nibble */
+__attribute__((target("avx2")))
+static inline __m256i byte_popcount_avx2(__m256i x)
+{
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i nibbles = _mm256_set1_epi8(0x0F);
+
+    __m256i low = _mm256_shuffle_epi8(table, _mm256_and_si256(x, nibbles));
+    __m256i high = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(x, 4), nibbles));
+
+    return _mm256_add_epi8(low, high);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i fold_bytes_avx2(__m256i x)
+{
+    return _mm256_maddubs_epi16(x, _mm256_set1_epi8(1));
+}
+
+__attribute__((target("avx2")))
+static void features_avx2(const EvalBatch* batch, EvalFeatures* features)
+{
+    const __m256i interior = _mm256_set1_epi16(INTERIOR);
+    const __m256i pairs = _mm256_set1_epi16(PAIRS);
+    const __m256i wall_pairs = _mm256_set1_epi16(WALL_PAIRS);
+
+    for (int i = 0; i < batch->nb_boards; i += 16) {
+        __m256i covered = _mm256_setzero_si256();
+        __m256i lost = _mm256_setzero_si256();
+        __m256i total_height = _mm256_setzero_si256();
+        __m256i total_holes = _mm256_setzero_si256();
+        __m256i total_bumpiness = _mm256_setzero_si256();
+        __m256i total_transitions = _mm256_setzero_si256();
+        __m256i total_wells = _mm256_setzero_si256();
+
+        for (int y = 0; y < BOARD_TOP; ++y) {
+            __m256i rows = _mm256_loadu_si256((const __m256i*)&batch->rows[y][i]);
+            lost = _mm256_or_si256(lost, _mm256_and_si256(rows, interior));
+        }
+
+        for (int top = BOARD_TOP; top < EVAL_ROWS; top += BYTE_COUNT_ROWS) {
+            int bottom = (top + BYTE_COUNT_ROWS < EVAL_ROWS) ? top + BYTE_COUNT_ROWS : EVAL_ROWS;
+
+            __m256i height = _mm256_setzero_si256();
+            __m256i holes = _mm256_setzero_si256();
+            __m256i bumpiness = _mm256_setzero_si256();
+            __m256i transitions = _mm256_setzero_si256();
+            __m256i wells = _mm256_setzero_si256();
+
+            for (int y = top; y < bottom; ++y) {
+                __m256i rows = _mm256_loadu_si256((const __m256i*)&batch->rows[y][i]);
+                __m256i row = _mm256_and_si256(rows, interior);
+
+                holes = _mm256_add_epi8(holes, byte_popcount_avx2(_mm256_andnot_si256(row, covered)));
+                covered = _mm256_or_si256(covered, row);
+                height = _mm256_add_epi8(height, byte_popcount_avx2(covered));
+
+                __m256i steps = _mm256_xor_si256(covered, _mm256_srli_epi16(covered, 1));
+                bumpiness = _mm256_add_epi8(bumpiness, byte_popcount_avx2(_mm256_and_si256(steps, pairs)));
+
+                __m256i changes = _mm256_xor_si256(rows, _mm256_srli_epi16(rows, 1));
+                transitions = _mm256_add_epi8(transitions, byte_popcount_avx2(_mm256_and_si256(changes, wall_pairs)));
+
+                __m256i walled = _mm256_and_si256(_mm256_slli_epi16(rows, 1), _mm256_srli_epi16(rows, 1));
+                walled = _mm256_andnot_si256(covered, _mm256_and_si256(walled, interior));
+                wells = _mm256_add_epi8(wells, byte_popcount_avx2(walled));
+            }
+
+            total_height = _mm256_add_epi16(total_height, fold_bytes_avx2(height));
+            total_holes = _mm256_add_epi16(total_holes, fold_bytes_avx2(holes));
+            total_bumpiness = _mm256_add_epi16(total_bumpiness, fold_bytes_avx2(bumpiness));
+            total_transitions = _mm256_add_epi16(total_transitions, fold_bytes_avx2(transitions));
+            total_wells = _mm256_add_epi16(total_wells, fold_bytes_avx2(wells));
+        }
+
+        _mm256_storeu_si256((__m256i*)&features->height[i], total_height);
+        _mm256_storeu_si256((__m256i*)&features->holes[i], total_holes);
+        _mm256_storeu_si256((__m256i*)&features->bumpiness[i], total_bumpiness);
+        _mm256_storeu_si256((__m256i*)&features->row_transitions[i], total_transitions);
+        _mm256_storeu_si256((__m256i*)&features->wells[i], total_wells);
+        _mm256_storeu_si256((__m256i*)&features->lost[i], lost);
+    }
+}
+
+#endif
+
+bool eval_kernel_is_supported(EvalKernel kernel)
+{
+    switch (kernel) {
+        case EVAL_KERNEL_SCALAR:
+            return true;
+
+#ifdef HAS_X86_KERNELS
+        case EVAL_KERNEL_SSE2:
+            return __builtin_cpu_supports("sse2");
+
+        case EVAL_KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+
+        default:
+            return false;
+    }
+}
+
+EvalKernel eval_best_kernel()
+{
+    for (EvalKernel kernel = EVAL_NB_KERNELS - 1; kernel > EVAL_KERNEL_SCALAR; --kernel)
+        if (eval_kernel_is_supported(kernel))
+            return kernel;
+
+    return EVAL_KERNEL_SCALAR;
+}
+
+void eval_batch_features(const EvalBatch* batch, EvalFeatures* features, EvalKernel kernel)
+{
+    switch (kernel) {
+#ifdef HAS_X86_KERNELS
+        case EVAL_KERNEL_SSE2:
+            features_sse2(batch, features);
+            break;
+
+        case EVAL_KERNEL_AVX2:
+            features_avx2(batch, features);
+            break;
+#endif
+
+        default:
+            features_scalar(batch, features);
+    }
+}
+
+void eval_batch_scores(const EvalBatch* batch, const int nb_cleared_lines[],
+                       const AiWeights* weights, double scores[])
+{
+    EvalFeatures features;
+
+    eval_batch_features(batch, &features, eval_best_kernel());
+
+    for (int i = 0; i < batch->nb_boards; ++i) {
+        BoardFeatures board = {
+            .height = features.height[i],
+            .holes = features.holes[i],
+            .bumpiness = features.bumpiness[i],
+            .row_transitions = features.row_transitions[i],
+            .wells = features.wells[i],
+            .lost = features.lost[i] != 0,
+        };
+
+        scores[i] = eval_score(&board, nb_cleared_lines[i], weights);
+    }
+}
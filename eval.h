@@ -0,0 +1,101 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+/*
+ * Board features for the bot, for one board or many at once.
+ *
+ * Every feature is a count of bits of the occupancy rows, taken a row at a
+ * time from the top (see eval_board_features). A batch stores the same row of
+ * all its boards next to each other, so the vector kernels handle a row of 8
+ * (SSE2) or 16 (AVX2) boards per instruction, one board per 16-bit lane. The
+ * best kernel the CPU supports is picked at runtime, with a scalar fallback.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ai.h"
+#include "core.h"
+
+/* Boards in a batch, a multiple of the widest vector which holds all the
+ * placements of a piece */
+#if AI_MAX_PLACEMENTS <= 64
+#define EVAL_BATCH_SIZE 64
+#else
+#define EVAL_BATCH_SIZE ((AI_MAX_PLACEMENTS + 15) / 16 * 16)
+#endif
+
+/* The rows which can hold blocks, including the ones above the board */
+#define EVAL_ROWS (BOARD_TOP + WINDOW_HEIGHT)
+
+typedef struct BoardFeatures {
+    int height;             /* Sum of the heights of the columns */
+    int holes;              /* Empty cells with a block above them */
+    int bumpiness;          /* Sum of the height differences of adjacent columns */
+    int row_transitions;    /* Changes between empty and occupied cells in rows */
+    int wells;              /* Open empty cells with blocks or walls on both sides */
+    bool lost;              /* Blocks are left above the board */
+} BoardFeatures;
+
+/*
+ * Boards stored as structure of arrays: rows[y][i] is row y of board i, from
+ * the top of the rows given to eval_batch_add.
+ */
+typedef struct EvalBatch {
+    BoardRow rows[EVAL_ROWS][EVAL_BATCH_SIZE];
+    int nb_boards;
+} EvalBatch;
+
+typedef struct EvalFeatures {
+    uint16_t height[EVAL_BATCH_SIZE];
+    uint16_t holes[EVAL_BATCH_SIZE];
+    uint16_t bumpiness[EVAL_BATCH_SIZE];
+    uint16_t row_transitions[EVAL_BATCH_SIZE];
+    uint16_t wells[EVAL_BATCH_SIZE];
+    uint16_t lost[EVAL_BATCH_SIZE];
+} EvalFeatures;
+
+typedef enum EvalKernel {
+    EVAL_KERNEL_SCALAR,
+    EVAL_KERNEL_SSE2,
+    EVAL_KERNEL_AVX2,
+    EVAL_NB_KERNELS,
+} EvalKernel;
+
+extern const char* const eval_kernel_names[EVAL_NB_KERNELS];
+
+void eval_board_features(const BoardRow rows[BOARD_ROWS], BoardFeatures* features);
+
+/* Higher is better, AI_LOST_SCORE for a lost board */
+double eval_score(const BoardFeatures* features, int nb_cleared_lines, const AiWeights* weights);
+
+static inline void eval_batch_clear(EvalBatch* batch)
+{
+    batch->nb_boards = 0;
+}
+
+/* Returns the index of the board in the batch, which must not be full */
+static inline int eval_batch_add(EvalBatch* batch, const BoardRow rows[BOARD_ROWS])
+{
+    int i = batch->nb_boards++;
+
+    for (int y = 0; y < EVAL_ROWS; ++y)
+        batch->rows[y][i] = rows[y];
+
+    return i;
+}
+
+bool eval_kernel_is_supported(EvalKernel kernel);
+
+/* The fastest kernel supported by this CPU */
+EvalKernel eval_best_kernel();
+
+/* Lanes past the last board of the batch are left undefined */
+void eval_batch_features(const EvalBatch* batch, EvalFeatures* features, EvalKernel kernel);
+
+/* Score every board of the batch with the best kernel, given the lines cleared
+ * by each of them */
+void eval_batch_scores(const EvalBatch* batch, const int nb_cleared_lines[],
+                       const AiWeights* weights, double scores[]);
+
+#endif
@@ -0,0 +1,89 @@
+#include "frame_clock.h"
+
+#include <errno.h>
+
+static const long ns_per_s = 1000000000L;
+
+static long long to_ns(struct timespec t)
+{
+    return (long long)t.tv_sec * ns_per_s + t.tv_nsec;
+}
+
+static void add_ns(struct timespec* t, long long ns)
+{
+    long long total = to_ns(*t) + ns;
+
+    t->tv_sec = total / ns_per_s;
+    t->tv_nsec = total % ns_per_s;
+}
+
+static struct timespec now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t;
+}
+
+void frame_clock_init(FrameClock* clock, long frame_ns)
+{
+    *clock = (FrameClock) {0};
+
+    clock->frame_ns = frame_ns;
+    clock->deadline = now();
+    add_ns(&clock->deadline, frame_ns);
+}
+
+void frame_clock_wait_frames(FrameClock* clock, int nb_frames)
+{
+    add_ns(&clock->deadline, (long long)(nb_frames - 1) * clock->frame_ns);
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &clock->deadline, NULL) == EINTR)
+        ;
+
+    long long jitter = to_ns(now()) - to_ns(clock->deadline);
+
+    if (jitter > clock->max_jitter_ns)
+        clock->max_jitter_ns = jitter;
+
+    clock->total_jitter_ns += jitter;
+    ++clock->nb_waits;
+    clock->nb_frames += nb_frames;
+
+    add_ns(&clock->deadline, clock->frame_ns);
+}
+
+void frame_clock_wait(FrameClock* clock)
+{
+    frame_clock_wait_frames(clock, 1);
+}
+
+bool frame_clock_is_late(FrameClock* clock)
+{
+    struct timespec t = now();
+    long long late_ns = to_ns(t) - to_ns(clock->deadline);
+
+    if (late_ns < 0)
+        return false;
+
+    long long nb_late = late_ns / clock->frame_ns + 1;
+
+    if (nb_late > MAX_CATCH_UP_FRAMES) {
+        /* Probably suspended or badly starved, catching up would only make
+         * the game unplayable for a while */
+        clock->nb_dropped_frames += nb_late;
+        clock->deadline = t;
+        add_ns(&clock->deadline, clock->frame_ns);
+        return false;
+    }
+
+    ++clock->nb_late_frames;
+    ++clock->nb_frames;
+    add_ns(&clock->deadline, clock->frame_ns);
+
+    return true;
+}
+
+long frame_clock_mean_jitter_ns(const FrameClock* clock)
+{
+    return (clock->nb_waits > 0) ? clock->total_jitter_ns / clock->nb_waits : 0;
+}
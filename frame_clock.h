@@ -0,0 +1,50 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+/*
+ * Fixed timestep pacing on the monotonic clock.
+ *
+ * Every frame has an absolute deadline, so the time spent updating and drawing
+ * doesn't make the game drift: a slow frame only shortens the next sleep. When
+ * the loop falls behind by more than a frame, the caller is expected to run
+ * the missed updates without drawing them (see frame_clock_is_late).
+ */
+
+#include <stdbool.h>
+#include <time.h>
+
+/* Never catch up on more frames than this, resynchronise instead */
+#define MAX_CATCH_UP_FRAMES 8
+
+typedef struct FrameClock {
+    /* Deadline of the next frame */
+    struct timespec deadline;
+    long frame_ns;
+
+    /* Statistics */
+    long nb_frames;
+    long nb_waits;
+    long nb_late_frames;     /* Frames updated without being drawn */
+    long nb_dropped_frames;  /* Frames skipped altogether by a resync */
+    long max_jitter_ns;      /* Worst wake up time past a deadline */
+    long long total_jitter_ns;
+} FrameClock;
+
+void frame_clock_init(FrameClock* clock, long frame_ns);
+
+/* Sleep until the end of the current frame */
+void frame_clock_wait(FrameClock* clock);
+
+/* Sleep for nb_frames whole frames, keeping the deadlines aligned */
+void frame_clock_wait_frames(FrameClock* clock, int nb_frames);
+
+/*
+ * Returns true if the deadline of the next frame has already passed, in which
+ * case that frame is counted as late and should be updated right away. Gives
+ * up and resynchronises on the current time after MAX_CATCH_UP_FRAMES.
+ */
+bool frame_clock_is_late(FrameClock* clock);
+
+long frame_clock_mean_jitter_ns(const FrameClock* clock);
+
+#endif
@@ -0,0 +1,203 @@
+#include "frame_stats.h"
+
+#include <string.h>
+#include <time.h>
+
+const char* const frame_phase_names[NB_FRAME_PHASES] = {
+    [FRAME_PHASE_INPUT] = "Input",
+    [FRAME_PHASE_UPDATE] = "Update",
+    [FRAME_PHASE_DRAW] = "Draw",
+    [FRAME_PHASE_SLACK] = "Slack",
+};
+
+/*
+ * Histogram buckets: values under 2^SUB_BITS ns have their own bucket, then
+ * every power of 2 is split in 2^SUB_BITS buckets.
+ */
+#define SUB_BITS 5
+#define NB_SUB_BUCKETS (1 << SUB_BITS)
+#define NB_BUCKETS ((32 - SUB_BITS + 1) * NB_SUB_BUCKETS)
+
+static long long now_ns()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+void frame_stats_init(FrameStats* stats)
+{
+    memset(stats->frames, 0, sizeof(stats->frames));
+    atomic_init(&stats->nb_frames, 0);
+
+    memset(&stats->current, 0, sizeof(stats->current));
+    stats->phase = FRAME_PHASE_INPUT;
+    stats->phase_start_ns = 0;
+}
+
+static void end_phase(FrameStats* stats, long long now)
+{
+    if (stats->phase_start_ns == 0)
+        return;
+
+    long long elapsed = now - stats->phase_start_ns;
+    uint32_t* ns = &stats->current.ns[stats->phase];
+
+    *ns = (elapsed + *ns > UINT32_MAX) ? UINT32_MAX : *ns + elapsed;
+}
+
+void frame_stats_begin(FrameStats* stats, FramePhase phase)
+{
+    long long now = now_ns();
+
+    end_phase(stats, now);
+    stats->phase = phase;
+    stats->phase_start_ns = now;
+}
+
+void frame_stats_end_frame(FrameStats* stats)
+{
+    end_phase(stats, now_ns());
+    stats->phase_start_ns = 0;
+
+    uint64_t nb_frames = atomic_load_explicit(&stats->nb_frames, memory_order_relaxed);
+
+    stats->frames[nb_frames & (FRAME_STATS_CAPACITY - 1)] = stats->current;
+    atomic_store_explicit(&stats->nb_frames, nb_frames + 1, memory_order_release);
+
+    memset(&stats->current, 0, sizeof(stats->current));
+}
+
+/* Copy the frames in the buffer which are complete, returns their number and
+ * the index of the first one in first */
+static int copy_frames(const FrameStats* stats, FrameTiming frames[FRAME_STATS_CAPACITY],
+                       uint64_t* first)
+{
+    uint64_t end = atomic_load_explicit(&stats->nb_frames, memory_order_acquire);
+    uint64_t begin = (end > FRAME_STATS_CAPACITY) ? end - FRAME_STATS_CAPACITY : 0;
+
+    for (uint64_t f = begin; f < end; ++f)
+        frames[f - begin] = stats->frames[f & (FRAME_STATS_CAPACITY - 1)];
+
+    atomic_thread_fence(memory_order_acquire);
+
+    /* The writer may have gone on meanwhile, overwriting the oldest frames
+     * and writing over the one after them */
+    uint64_t now = atomic_load_explicit(&stats->nb_frames, memory_order_relaxed);
+    uint64_t valid = (now + 1 > FRAME_STATS_CAPACITY) ? now + 1 - FRAME_STATS_CAPACITY : 0;
+
+    if (valid > end)
+        valid = end;
+
+    if (valid > begin) {
+        memmove(frames, &frames[valid - begin], (end - valid) * sizeof(FrameTiming));
+        begin = valid;
+    }
+
+    *first = begin;
+
+    return end - begin;
+}
+
+static int bucket_of(uint32_t ns)
+{
+    if (ns < NB_SUB_BUCKETS)
+        return ns;
+
+    int exponent = 31 - __builtin_clz(ns);
+    int sub = (ns >> (exponent - SUB_BITS)) & (NB_SUB_BUCKETS - 1);
+
+    return (exponent - SUB_BITS + 1) * NB_SUB_BUCKETS + sub;
+}
+
+/* Middle of the values falling in a bucket */
+static long bucket_value(int bucket)
+{
+    if (bucket < NB_SUB_BUCKETS)
+        return bucket;
+
+    int exponent = bucket / NB_SUB_BUCKETS + SUB_BITS - 1;
+    long low = (long)(NB_SUB_BUCKETS + bucket % NB_SUB_BUCKETS) << (exponent - SUB_BITS);
+
+    return low + (1L << (exponent - SUB_BITS)) / 2;
+}
+
+static long percentile(const int histogram[NB_BUCKETS], int nb_values, int percent)
+{
+    int rank = (nb_values * percent + 99) / 100;
+    int count = 0;
+
+    for (int bucket = 0; bucket < NB_BUCKETS; ++bucket) {
+        count += histogram[bucket];
+
+        if (count >= rank && count > 0)
+            return bucket_value(bucket);
+    }
+
+    return 0;
+}
+
+int frame_stats_summarise(const FrameStats* stats, PhaseSummary summaries[NB_FRAME_PHASES])
+{
+    FrameTiming frames[FRAME_STATS_CAPACITY];
+    int histogram[NB_BUCKETS];
+    uint64_t first;
+
+    int nb_frames = copy_frames(stats, frames, &first);
+
+    for (int phase = 0; phase < NB_FRAME_PHASES; ++phase) {
+        PhaseSummary* summary = &summaries[phase];
+
+        memset(histogram, 0, sizeof(histogram));
+        summary->max_ns = 0;
+
+        for (int i = 0; i < nb_frames; ++i) {
+            uint32_t ns = frames[i].ns[phase];
+
+            ++histogram[bucket_of(ns)];
+
+            if (ns > summary->max_ns)
+                summary->max_ns = ns;
+        }
+
+        summary->p50_ns = percentile(histogram, nb_frames, 50);
+        summary->p99_ns = percentile(histogram, nb_frames, 99);
+    }
+
+    return nb_frames;
+}
+
+void frame_stats_dump(const FrameStats* stats, FILE* file)
+{
+    FrameTiming frames[FRAME_STATS_CAPACITY];
+    PhaseSummary summaries[NB_FRAME_PHASES];
+    uint64_t first;
+
+    int nb_summarised = frame_stats_summarise(stats, summaries);
+
+    fprintf(file, "# Last %d frames, in microseconds\n", nb_summarised);
+    fprintf(file, "# phase p50 p99 max\n");
+
+    for (int phase = 0; phase < NB_FRAME_PHASES; ++phase)
+        fprintf(file, "# %s %.1f %.1f %.1f\n", frame_phase_names[phase],
+                summaries[phase].p50_ns / 1e3, summaries[phase].p99_ns / 1e3,
+                summaries[phase].max_ns / 1e3);
+
+    int nb_frames = copy_frames(stats, frames, &first);
+
+    fprintf(file, "frame");
+
+    for (int phase = 0; phase < NB_FRAME_PHASES; ++phase)
+        fprintf(file, " %s", frame_phase_names[phase]);
+
+    fprintf(file, "\n");
+
+    for (int i = 0; i < nb_frames; ++i) {
+        fprintf(file, "%lu", (unsigned long)(first + i));
+
+        for (int phase = 0; phase < NB_FRAME_PHASES; ++phase)
+            fprintf(file, " %.1f", frames[i].ns[phase] / 1e3);
+
+        fprintf(file, "\n");
+    }
+}
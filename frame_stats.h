@@ -0,0 +1,73 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+/*
+ * Where the time of each frame goes: reading the keyboard, updating the game,
+ * drawing, and sleeping until the next frame.
+ *
+ * The last FRAME_STATS_CAPACITY frames are kept in a ring buffer written by
+ * the main loop only. Readers never block it: they copy the frames, then
+ * check that the writer didn't come back over them in the meantime.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* A power of 2, about a minute of frames */
+#define FRAME_STATS_CAPACITY 4096
+
+typedef enum FramePhase {
+    FRAME_PHASE_INPUT,
+    FRAME_PHASE_UPDATE,
+    FRAME_PHASE_DRAW,
+
+    /* Time left in the frame, spent sleeping */
+    FRAME_PHASE_SLACK,
+
+    NB_FRAME_PHASES,
+} FramePhase;
+
+extern const char* const frame_phase_names[NB_FRAME_PHASES];
+
+typedef struct FrameTiming {
+    uint32_t ns[NB_FRAME_PHASES];
+} FrameTiming;
+
+typedef struct FrameStats {
+    FrameTiming frames[FRAME_STATS_CAPACITY];
+
+    /* Number of frames written so far */
+    _Atomic uint64_t nb_frames;
+
+    /* The frame being timed, by the main loop */
+    FrameTiming current;
+    FramePhase phase;
+    long long phase_start_ns;
+} FrameStats;
+
+typedef struct PhaseSummary {
+    long p50_ns;
+    long p99_ns;
+    long max_ns;
+} PhaseSummary;
+
+void frame_stats_init(FrameStats* stats);
+
+/* Start timing a phase, ending the previous one. Time spent twice in a phase
+ * during a frame, like late frames updated twice, adds up */
+void frame_stats_begin(FrameStats* stats, FramePhase phase);
+
+/* End the last phase and the frame, and push its timings */
+void frame_stats_end_frame(FrameStats* stats);
+
+/*
+ * Percentiles of the frames still in the ring buffer, from a histogram with a
+ * precision of about 3%. Returns the number of frames summarised.
+ */
+int frame_stats_summarise(const FrameStats* stats, PhaseSummary summaries[NB_FRAME_PHASES]);
+
+/* Write the summary and the timings of every frame in the buffer */
+void frame_stats_dump(const FrameStats* stats, FILE* file);
+
+#endif
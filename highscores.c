@@ -0,0 +1,218 @@
+#include "highscores.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void highscores_init(Highscores* highscores)
+{
+    highscores->nb_entries = 0;
+}
+
+bool highscores_load(Highscores* highscores, const char* path)
+{
+    highscores_init(highscores);
+
+    FILE* file = fopen(path, "r");
+
+    if (file == NULL)
+        return access(path, F_OK) != 0;
+
+    char line[256];
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        HighscoreEntry entry;
+
+        /* Skip anything else, so a damaged line only loses itself */
+        if (sscanf(line, "%ld %d %d %d %lld %hu", &entry.score, &entry.lines, &entry.level,
+                   &entry.start_level, &entry.date, &entry.seed) == 6)
+            highscores_insert(highscores, &entry);
+    }
+
+    bool ok = !ferror(file);
+    fclose(file);
+
+    return ok;
+}
+
+long highscores_best(const Highscores* highscores)
+{
+    return (highscores->nb_entries > 0) ? highscores->entries[0].score : 0;
+}
+
+int highscores_insert(Highscores* highscores, const HighscoreEntry* entry)
+{
+    int rank = 0;
+
+    /* After the entries with the same score, which were there first */
+    while (rank < highscores->nb_entries && highscores->entries[rank].score >= entry->score)
+        ++rank;
+
+    if (rank == HIGHSCORES_CAPACITY)
+        return -1;
+
+    if (highscores->nb_entries < HIGHSCORES_CAPACITY)
+        ++highscores->nb_entries;
+
+    memmove(&highscores->entries[rank + 1], &highscores->entries[rank],
+            (highscores->nb_entries - rank - 1) * sizeof(highscores->entries[0]));
+    highscores->entries[rank] = *entry;
+
+    return rank;
+}
+
+/* Make the rename of a file in the directory of path durable */
+static void sync_directory(const char* path)
+{
+    char directory[PATH_MAX];
+    const char* slash = strrchr(path, '/');
+
+    if (slash == NULL)
+        snprintf(directory, sizeof(directory), ".");
+    else
+        snprintf(directory, sizeof(directory), "%.*s", (int)(slash - path + 1), path);
+
+    int fd = open(directory, O_RDONLY | O_DIRECTORY);
+
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+static bool save(const Highscores* highscores, const char* path)
+{
+    char temporary_path[PATH_MAX];
+
+    if (snprintf(temporary_path, sizeof(temporary_path), "%s.XXXXXX", path) >= PATH_MAX)
+        return false;
+
+    int fd = mkstemp(temporary_path);
+
+    if (fd < 0)
+        return false;
+
+    /* mkstemp only lets the owner read it */
+    fchmod(fd, 0644);
+
+    FILE* file = fdopen(fd, "w");
+
+    if (file == NULL) {
+        close(fd);
+        unlink(temporary_path);
+        return false;
+    }
+
+    for (int i = 0; i < highscores->nb_entries; ++i) {
+        const HighscoreEntry* entry = &highscores->entries[i];
+
+        fprintf(file, "%ld %d %d %d %lld %u\n", entry->score, entry->lines, entry->level,
+                entry->start_level, entry->date, entry->seed);
+    }
+
+    /* The data must be on disk before the rename is */
+    bool ok = fflush(file) == 0 && fsync(fd) == 0;
+    ok = (fclose(file) == 0) && ok;
+
+    if (ok)
+        ok = rename(temporary_path, path) == 0;
+
+    if (!ok) {
+        unlink(temporary_path);
+        return false;
+    }
+
+    sync_directory(path);
+
+    return true;
+}
+
+/* The table itself is replaced on every write, so the lock is taken on a file
+ * of its own which stays in place. Returns the locked file, or -1 */
+static int lock_table(const char* path)
+{
+    char lock_path[PATH_MAX];
+
+    if (snprintf(lock_path, sizeof(lock_path), "%s.lock", path) >= PATH_MAX)
+        return -1;
+
+    int lock_fd = open(lock_path, O_RDWR | O_CREAT, 0666);
+
+    if (lock_fd < 0)
+        return -1;
+
+    if (flock(lock_fd, LOCK_EX) != 0) {
+        close(lock_fd);
+        return -1;
+    }
+
+    return lock_fd;
+}
+
+static void unlock_table(int lock_fd)
+{
+    flock(lock_fd, LOCK_UN);
+    close(lock_fd);
+}
+
+bool highscores_add(const char* path, const HighscoreEntry* entry,
+                    Highscores* highscores, int* rank)
+{
+    int lock_fd = lock_table(path);
+
+    if (lock_fd < 0)
+        return false;
+
+    bool ok = highscores_load(highscores, path);
+
+    if (ok) {
+        *rank = highscores_insert(highscores, entry);
+
+        if (*rank >= 0)
+            ok = save(highscores, path);
+    }
+
+    unlock_table(lock_fd);
+
+    return ok;
+}
+
+bool highscores_import(const char* path, const char* old_path, Highscores* highscores)
+{
+    /* Nothing to import, as on every start but the first one */
+    if (access(old_path, F_OK) != 0)
+        return highscores_load(highscores, path);
+
+    int lock_fd = lock_table(path);
+
+    if (lock_fd < 0)
+        return false;
+
+    bool ok = highscores_load(highscores, path);
+
+    /* Another game may have imported it since it was seen above */
+    FILE* file = ok ? fopen(old_path, "r") : NULL;
+
+    if (file != NULL) {
+        HighscoreEntry entry = {0};
+
+        if (fscanf(file, "%ld", &entry.score) == 1) {
+            if (highscores_insert(highscores, &entry) >= 0)
+                ok = save(highscores, path);
+
+            if (ok)
+                remove(old_path);
+        }
+
+        fclose(file);
+    }
+
+    unlock_table(lock_fd);
+
+    return ok;
+}
@@ -0,0 +1,64 @@
+#ifndef HIGHSCORES_H
+#define HIGHSCORES_H
+
+/*
+ * The best games played on this machine.
+ *
+ * The table is a text file with one game per line, best first:
+ *   score lines level start_level date seed
+ * with the date in seconds since the epoch.
+ *
+ * Several games can end at the same time, so a new score is added under an
+ * exclusive lock, to the table as it is on disk then rather than as it was
+ * when the game started. The table is written to a temporary file which then
+ * replaces the old one, so a crash never leaves a half written table behind.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define HIGHSCORES_CAPACITY 10
+
+typedef struct HighscoreEntry {
+    long score;
+    int lines;
+    int level;
+    int start_level;
+    long long date;
+    uint16_t seed;
+} HighscoreEntry;
+
+typedef struct Highscores {
+    HighscoreEntry entries[HIGHSCORES_CAPACITY];
+    int nb_entries;
+} Highscores;
+
+void highscores_init(Highscores* highscores);
+
+/* A missing file is an empty table. Returns false if it can't be read */
+bool highscores_load(Highscores* highscores, const char* path);
+
+/* Best score of the table, 0 if empty */
+long highscores_best(const Highscores* highscores);
+
+/* Returns the rank of the entry in the table, from 0, or -1 if it is not good
+ * enough to enter it */
+int highscores_insert(Highscores* highscores, const HighscoreEntry* entry);
+
+/*
+ * Add the entry to the table stored at path, which is then loaded in
+ * highscores. rank is set like highscores_insert does. Returns false if the
+ * table could not be updated.
+ */
+bool highscores_add(const char* path, const HighscoreEntry* entry,
+                    Highscores* highscores, int* rank);
+
+/*
+ * Load the table stored at path, after moving into it the best score saved at
+ * old_path by older versions, if any. The file at old_path is removed under
+ * the same lock as highscores_add takes, so it is imported once. Returns false
+ * if the table could not be read or updated.
+ */
+bool highscores_import(const char* path, const char* old_path, Highscores* highscores);
+
+#endif
@@ -0,0 +1,265 @@
+#include "keyboard.h"
+
+#include <errno.h>
+#include <ncurses.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Terminals don't report key releases, only the key again while it is held,
+ * after a first delay (from 250 to 660 ms usually) and then at a steady rate.
+ * A button is held when the key comes again after at least the first delay,
+ * and released once it stops coming. Quicker presses are separate taps.
+ */
+#define MIN_REPEAT_DELAY_NS 200000000LL
+#define MAX_REPEAT_DELAY_NS 700000000LL
+#define RELEASE_DELAY_NS 100000000LL
+
+/* Time to wait for the rest of an escape sequence */
+#define ESCAPE_TIMEOUT_MS 25
+
+/* How often the thread checks if it must stop */
+#define POLL_TIMEOUT_MS 50
+
+static long long now_ns()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+bool key_queue_push(KeyQueue* queue, KeyEvent event)
+{
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    if (tail - head == KEY_QUEUE_CAPACITY)
+        return false;
+
+    queue->events[tail & (KEY_QUEUE_CAPACITY - 1)] = event;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+bool key_queue_peek(KeyQueue* queue, KeyEvent* event)
+{
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if (head == tail)
+        return false;
+
+    *event = queue->events[head & (KEY_QUEUE_CAPACITY - 1)];
+
+    return true;
+}
+
+void key_queue_pop(KeyQueue* queue)
+{
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+}
+
+static void push_key(Keyboard* keyboard, int key)
+{
+    KeyEvent event = { .key = key, .time_ns = now_ns() };
+
+    if (!key_queue_push(&keyboard->queue, event))
+        atomic_fetch_add(&keyboard->nb_dropped, 1);
+}
+
+/* The key of the last character of an arrow sequence, ESC [ A or ESC O A */
+static int arrow_key(unsigned char c)
+{
+    switch (c) {
+        case 'A': return KEY_UP;
+        case 'B': return KEY_DOWN;
+        case 'C': return KEY_RIGHT;
+        case 'D': return KEY_LEFT;
+    }
+
+    return 0;
+}
+
+static void* keyboard_thread(void* arg)
+{
+    Keyboard* keyboard = arg;
+
+    /* Position in an escape sequence: 0 outside, 1 after ESC, 2 after the
+     * opening [ or O, skipping parameters until the final character */
+    int escape = 0;
+
+    while (!atomic_load(&keyboard->stop)) {
+        struct pollfd pollfd = { .fd = keyboard->fd, .events = POLLIN };
+        int timeout = escape ? ESCAPE_TIMEOUT_MS : POLL_TIMEOUT_MS;
+        int ready = poll(&pollfd, 1, timeout);
+
+        if (ready < 0 && errno != EINTR)
+            break;
+
+        if (ready == 0) {
+            /* A lone escape key */
+            if (escape)
+                push_key(keyboard, 27);
+
+            escape = 0;
+            continue;
+        }
+
+        if (ready < 0)
+            continue;
+
+        unsigned char buffer[64];
+        ssize_t size = read(keyboard->fd, buffer, sizeof(buffer));
+
+        if (size <= 0)
+            break;
+
+        for (ssize_t i = 0; i < size; ++i) {
+            unsigned char c = buffer[i];
+
+            if (escape == 0) {
+                if (c == 27)
+                    escape = 1;
+                else
+                    push_key(keyboard, c);
+            } else if (escape == 1) {
+                escape = (c == '[' || c == 'O') ? 2 : 0;
+            } else if (c >= 0x40 && c <= 0x7E) {
+                /* Final character, modifiers like ESC [ 1 ; 5 C are ignored */
+                if (arrow_key(c))
+                    push_key(keyboard, arrow_key(c));
+
+                escape = 0;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+bool keyboard_start(Keyboard* keyboard, int fd)
+{
+    keyboard->fd = fd;
+    atomic_init(&keyboard->queue.head, 0);
+    atomic_init(&keyboard->queue.tail, 0);
+    atomic_init(&keyboard->stop, false);
+    atomic_init(&keyboard->nb_dropped, 0);
+
+    return pthread_create(&keyboard->thread, NULL, keyboard_thread, keyboard) == 0;
+}
+
+void keyboard_stop(Keyboard* keyboard)
+{
+    atomic_store(&keyboard->stop, true);
+    pthread_join(keyboard->thread, NULL);
+}
+
+/* The button of the game a key stands for, if any */
+Input key_button(int key)
+{
+    switch (key) {
+        case 'h':
+        case KEY_LEFT:
+            return INPUT_LEFT;
+
+        case 'l':
+        case KEY_RIGHT:
+            return INPUT_RIGHT;
+
+        case 'j':
+        case KEY_DOWN:
+            return INPUT_DOWN;
+
+        case 'k':
+        case 'c':
+        case KEY_UP:
+            return INPUT_ROTATE_CW;
+
+        case 'e':
+        case 'x':
+            return INPUT_ROTATE_CCW;
+    }
+
+    return INPUT_NONE;
+}
+
+void controller_init(Controller* controller)
+{
+    *controller = (Controller) {0};
+}
+
+static Button* button_of(Controller* controller, Input button)
+{
+    return &controller->buttons[__builtin_ctz(button)];
+}
+
+bool controller_event(Controller* controller, Input input, long long time_ns, long long now_ns)
+{
+    Button* button = button_of(controller, input);
+    long long delay = time_ns - button->last_event_ns;
+
+    if (button->state == KEY_STATE_RELEASED
+            || (button->state == KEY_STATE_PRESSED && delay < MIN_REPEAT_DELAY_NS)) {
+        if (controller->presses & input)
+            return false;
+
+        controller->presses |= input;
+        button->state = KEY_STATE_PRESSED;
+        button->nb_frames = 0;
+
+        long long latency = now_ns - time_ns;
+
+        ++controller->nb_presses;
+        controller->total_latency_ns += latency;
+
+        if (latency > controller->max_latency_ns)
+            controller->max_latency_ns = latency;
+    } else {
+        button->state = KEY_STATE_HELD;
+    }
+
+    button->last_event_ns = time_ns;
+
+    return true;
+}
+
+Input controller_frame(Controller* controller, long long now_ns)
+{
+    Input input = controller->presses;
+
+    controller->presses = INPUT_NONE;
+
+    for (Input input_button = INPUT_LEFT; input_button <= INPUT_ROTATE_CCW; input_button <<= 1) {
+        Button* button = button_of(controller, input_button);
+
+        if (button->state == KEY_STATE_RELEASED)
+            continue;
+
+        long long idle = now_ns - button->last_event_ns;
+
+        if (idle > ((button->state == KEY_STATE_HELD) ? RELEASE_DELAY_NS : MAX_REPEAT_DELAY_NS)) {
+            button->state = KEY_STATE_RELEASED;
+            continue;
+        }
+
+        ++button->nb_frames;
+
+        if (button->state != KEY_STATE_HELD)
+            continue;
+
+        /* Rotations don't repeat */
+        if ((input_button & (INPUT_LEFT | INPUT_RIGHT)) && button->nb_frames >= DAS_DELAY) {
+            input |= input_button;
+            button->nb_frames = DAS_DELAY - DAS_PERIOD;
+        }
+
+        if (input_button == INPUT_DOWN && button->nb_frames % SOFT_DROP_PERIOD == 0)
+            input |= INPUT_DOWN;
+    }
+
+    return input;
+}
@@ -0,0 +1,113 @@
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+/*
+ * Keyboard input, read by its own thread.
+ *
+ * The thread blocks on the terminal, decodes the escape sequences of the
+ * arrow keys and pushes every key with the time it was read to a single
+ * producer, single consumer queue. The game loop takes all the keys of the
+ * frame at once, so no key waits for the next frame because another one came
+ * first.
+ *
+ * A Controller then turns the keys into the buttons of each frame, with the
+ * delayed auto shift of the NES: a direction held for 16 frames shifts the
+ * piece again, then every 6 frames.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "core.h"
+
+/* A power of 2 */
+#define KEY_QUEUE_CAPACITY 256
+
+typedef struct KeyEvent {
+    /* A character, or one of the KEY_ codes of ncurses for arrows */
+    int key;
+
+    /* When the key was read, on the monotonic clock */
+    long long time_ns;
+} KeyEvent;
+
+typedef struct KeyQueue {
+    KeyEvent events[KEY_QUEUE_CAPACITY];
+
+    /* Only written by the consumer and the producer respectively */
+    _Atomic unsigned int head;
+    _Atomic unsigned int tail;
+} KeyQueue;
+
+/* Returns false if the queue is full */
+bool key_queue_push(KeyQueue* queue, KeyEvent event);
+
+/* Look at the oldest event without removing it, returns false if empty */
+bool key_queue_peek(KeyQueue* queue, KeyEvent* event);
+void key_queue_pop(KeyQueue* queue);
+
+typedef struct Keyboard {
+    pthread_t thread;
+    int fd;
+    KeyQueue queue;
+    atomic_bool stop;
+
+    /* Keys lost because the queue was full */
+    atomic_long nb_dropped;
+} Keyboard;
+
+/* Start reading keys from fd, which must already be in cbreak mode */
+bool keyboard_start(Keyboard* keyboard, int fd);
+void keyboard_stop(Keyboard* keyboard);
+
+/* The button of the game a key stands for, if any */
+Input key_button(int key);
+
+/* NES timings, in frames */
+#define DAS_DELAY 16
+#define DAS_PERIOD 6
+#define SOFT_DROP_PERIOD 2
+
+typedef enum KeyState {
+    KEY_STATE_RELEASED,
+
+    /* Pressed, not known to be held yet */
+    KEY_STATE_PRESSED,
+
+    /* Held, as the terminal repeats it */
+    KEY_STATE_HELD,
+} KeyState;
+
+typedef struct Button {
+    KeyState state;
+    long long last_event_ns;
+
+    /* Frames since the button was pressed, or since the last auto shift */
+    int nb_frames;
+} Button;
+
+typedef struct Controller {
+    Button buttons[5];
+
+    /* Buttons pressed since the last frame */
+    Input presses;
+
+    /* Time between reading a key and giving it to the game */
+    long nb_presses;
+    long long total_latency_ns;
+    long long max_latency_ns;
+} Controller;
+
+void controller_init(Controller* controller);
+
+/*
+ * Feed a key event for a button to the controller. Returns false if the button
+ * was already pressed this frame, the event must then wait for the next one.
+ */
+bool controller_event(Controller* controller, Input input, long long time_ns, long long now_ns);
+
+/* The buttons of this frame */
+Input controller_frame(Controller* controller, long long now_ns);
+
+#endif
@@ -0,0 +1,238 @@
+#include "path.h"
+
+#include <assert.h>
+#include <string.h>
+
+typedef struct Expansion {
+    int frame;
+
+    /* Rows queued, from the ones of the next frame */
+    int tail;
+    int frame_start;
+} Expansion;
+
+/* Row of states of a phase, angle and height */
+static inline int make_row(int phase, int angle, int y)
+{
+    return (phase * 4 + angle) * PATH_ROWS + y;
+}
+
+static inline uint32_t make_state(int row, int column)
+{
+    return (uint32_t)row * PATH_COLUMNS + column;
+}
+
+/* Columns are bit x + 1, so a piece at x = -1 can be tested. Positions
+ * below the board never fit */
+static void compute_fits(PathSearch* search, const Game* game)
+{
+    for (int angle = 0; angle < 4; ++angle) {
+        int shape_number = get_shape_nb(game->ctetr.type, angle);
+
+        for (int y = 0; y < PATH_ROWS; ++y) {
+            uint32_t columns = 0;
+
+            for (int x = -1; x < PATH_COLUMNS - 1; ++x)
+                if (board_can_fit(&game->board, x, y, shape_number))
+                    columns |= (uint32_t)1 << (x + 1);
+
+            search->fits[angle][y] = columns;
+        }
+
+        search->fits[angle][PATH_ROWS] = 0;
+        search->fits[angle][PATH_ROWS + 1] = 0;
+    }
+}
+
+/* Places are found by frame then presses, the first one with some cells is
+ * the cheapest */
+static void add_ends(PathSearch* search, const Game* game, int row, uint32_t columns,
+                     int frame, int nb_presses)
+{
+    int angle = row / PATH_ROWS % 4;
+    int y = row % PATH_ROWS;
+    int shape_number = get_shape_nb(game->ctetr.type, angle);
+
+    for (; columns != 0; columns &= columns - 1) {
+        int column = __builtin_ctz(columns);
+        bool already_found = false;
+
+        /* O, I, S and Z look the same for several angles */
+        for (int a = 0; a < 4; ++a) {
+            int i = search->end_index[(a * PATH_ROWS + y) * PATH_COLUMNS + column];
+
+            if (i >= 0 && shape_masks[search->ends[i].placement.shape_number]
+                              == shape_masks[shape_number])
+                already_found = true;
+        }
+
+        if (already_found)
+            continue;
+
+        PathEnd* end = &search->ends[search->nb_ends];
+
+        end->placement.x = column - 1;
+        end->placement.y = y;
+        end->placement.angle = angle;
+        end->placement.shape_number = shape_number;
+        end->nb_frames = frame;
+        end->nb_presses = nb_presses;
+        end->state = make_state(row, column);
+
+        search->end_index[(angle * PATH_ROWS + y) * PATH_COLUMNS + column] = search->nb_ends++;
+    }
+}
+
+/*
+ * Mark the states of columns in row reached for the first time, coming from
+ * the same columns of from_row shifted by dx, and queue them.
+ */
+static void reach(PathSearch* search, Expansion* expansion, int row, uint32_t columns,
+                  int from_row, int dx, Input input, int nb_presses)
+{
+    columns &= ~search->visited[row];
+
+    if (columns == 0)
+        return;
+
+    search->visited[row] |= columns;
+
+    /* Both shifts of a row go to the same one */
+    if (expansion->tail > expansion->frame_start
+        && search->queue[expansion->tail - 1].row == row
+        && search->queue[expansion->tail - 1].nb_presses == nb_presses)
+        search->queue[expansion->tail - 1].columns |= columns;
+    else
+        search->queue[expansion->tail++] = (PathRow) {columns, row, nb_presses};
+
+    for (; columns != 0; columns &= columns - 1) {
+        int column = __builtin_ctz(columns);
+        uint32_t state = make_state(row, column);
+
+        search->parent[state] = make_state(from_row, column - dx);
+        search->input[state] = input;
+    }
+}
+
+/*
+ * Every next state of a row, the ones where no button is pressed or the ones
+ * where one is, following game_step. The pieces which can't fall at the
+ * gravity frame lock instead.
+ */
+static void expand(PathSearch* search, const Game* game, Expansion* expansion,
+                   const PathRow* from, bool press)
+{
+    int fall_rate = search->fall_rate;
+    int phase = from->row / (4 * PATH_ROWS);
+    int angle = from->row / PATH_ROWS % 4;
+    int y = from->row % PATH_ROWS;
+    uint32_t columns = from->columns;
+    const uint32_t* fits = search->fits[angle];
+
+    if (phase == 0) {
+        if (!press)
+            add_ends(search, game, from->row, columns & ~fits[y + 1], expansion->frame,
+                     from->nb_presses);
+
+        columns &= fits[y + 1];
+        ++y;
+    }
+
+    if (columns == 0)
+        return;
+
+    int next_phase = (phase + 1) % fall_rate;
+
+    if (!press) {
+        reach(search, expansion, make_row(next_phase, angle, y), columns, from->row, 0,
+              INPUT_NONE, from->nb_presses);
+        return;
+    }
+
+    int nb_presses = from->nb_presses + 1;
+    int cw = (angle + 1) % 4;
+    int ccw = (angle + 3) % 4;
+    uint32_t down = columns & fits[y + 1];
+
+    reach(search, expansion, make_row(next_phase, angle, y), (columns >> 1) & fits[y],
+          from->row, -1, INPUT_LEFT, nb_presses);
+    reach(search, expansion, make_row(next_phase, angle, y), (columns << 1) & fits[y],
+          from->row, 1, INPUT_RIGHT, nb_presses);
+
+    /* nb_frames goes back to 0 before being incremented when the soft drop
+     * lands the piece */
+    reach(search, expansion, make_row(next_phase, angle, y + 1), down & fits[y + 2],
+          from->row, 0, INPUT_DOWN, nb_presses);
+    reach(search, expansion, make_row(1 % fall_rate, angle, y + 1), down & ~fits[y + 2],
+          from->row, 0, INPUT_DOWN, nb_presses);
+
+    reach(search, expansion, make_row(next_phase, cw, y), columns & search->fits[cw][y],
+          from->row, 0, INPUT_ROTATE_CW, nb_presses);
+    reach(search, expansion, make_row(next_phase, ccw, y), columns & search->fits[ccw][y],
+          from->row, 0, INPUT_ROTATE_CCW, nb_presses);
+}
+
+int path_search(PathSearch* search, const Game* game)
+{
+    const Tetrimino* ctetr = &game->ctetr;
+    int fall_rate = game->fall_rate;
+    Expansion expansion = {0, 0, 0};
+
+    assert(game->state == GAME_STATE_FALLING);
+    assert(fall_rate <= PATH_MAX_FALL_RATE);
+
+    search->nb_ends = 0;
+    search->fall_rate = fall_rate;
+    memset(search->end_index, -1, sizeof(search->end_index));
+
+    /* Only the states of this gravity can be reached */
+    memset(search->visited, 0, fall_rate * 4 * PATH_ROWS * sizeof(search->visited[0]));
+
+    compute_fits(search, game);
+
+    int start_row = make_row(game->nb_frames % fall_rate, ctetr->angle, ctetr->y);
+
+    reach(search, &expansion, start_row, (uint32_t)1 << (ctetr->x + 1), start_row, 0,
+          INPUT_NONE, 0);
+
+    /*
+     * The queue holds the rows of a frame sorted by presses. The states of the
+     * next frame are reached in the same order, by expanding the rows without
+     * pressing a button, then pressing one on the rows with one press less.
+     * The states are then reached first by their cheapest path, and between
+     * paths as cheap, by one which waits last rather than in between.
+     */
+    for (int head = 0; head < expansion.tail; ++expansion.frame) {
+        int frame_end = expansion.tail;
+        int pressed = head;
+
+        expansion.frame_start = frame_end;
+
+        for (int i = head; i < frame_end; ++i) {
+            /* Rows with at least two presses less */
+            while (search->queue[pressed].nb_presses + 1 < search->queue[i].nb_presses)
+                expand(search, game, &expansion, &search->queue[pressed++], true);
+
+            expand(search, game, &expansion, &search->queue[i], false);
+        }
+
+        while (pressed < frame_end)
+            expand(search, game, &expansion, &search->queue[pressed++], true);
+
+        head = frame_end;
+    }
+
+    return search->nb_ends;
+}
+
+int path_inputs(const PathSearch* search, const PathEnd* end, Input inputs[PATH_MAX_FRAMES])
+{
+    uint32_t state = end->state;
+
+    for (int i = end->nb_frames - 1; i >= 0; --i) {
+        inputs[i] = search->input[state];
+        state = search->parent[state];
+    }
+
+    return end->nb_frames;
+}
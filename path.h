@@ -0,0 +1,96 @@
+#ifndef PATH_H
+#define PATH_H
+
+/*
+ * Frame by frame inputs bringing the current tetrimino to every place where it
+ * can lock, including the tucks and spins which dropping it straight down after
+ * rotating and shifting it at the spawn height can't reach.
+ *
+ * The search follows game_step exactly, one button per frame: gravity every
+ * fall_rate frames counted by nb_frames, the timer reset of a soft drop which
+ * lands, shifts and rotations which fail against blocks. A state is the
+ * position and angle of the piece with nb_frames modulo fall_rate. States are
+ * searched breadth first, so each one is reached in the fewest frames, and
+ * with the fewest button presses between paths of the same length.
+ *
+ * Like the rows of the board, the columns of a row of states are the bits of
+ * a word, so the states of a whole row are moved at once, and only the ones
+ * reached for the first time are then looked at one by one.
+ *
+ * Nothing is allocated: a PathSearch holds every state, marked in a bitset
+ * when reached so the rest is never cleared, and is reused from a piece to
+ * the next.
+ */
+
+#include <stdint.h>
+
+#include "ai.h"
+#include "core.h"
+
+/* Gravity of level 0, the slowest one */
+#define PATH_MAX_FALL_RATE 48
+
+/* Every position of a piece with its cells in the board, x + 1 being the bit
+ * of a column */
+#define PATH_COLUMNS (WINDOW_WIDTH + 3)
+#define PATH_ROWS (WINDOW_HEIGHT + 1)
+#define PATH_NB_POSITIONS (4 * PATH_ROWS * PATH_COLUMNS)
+#define PATH_NB_STATES (PATH_MAX_FALL_RATE * PATH_NB_POSITIONS)
+
+/* The piece falls or locks within fall_rate frames, whatever the inputs */
+#define PATH_MAX_FRAMES ((PATH_ROWS + 1) * PATH_MAX_FALL_RATE)
+
+typedef struct PathEnd {
+    /* Where the tetrimino locks */
+    Placement placement;
+
+    /* Frames of inputs to get there, it locks at the following frame
+     * whatever the input, and how many of them press a button */
+    int nb_frames;
+    int nb_presses;
+
+    /* To get the inputs back, see path_inputs */
+    uint32_t state;
+} PathEnd;
+
+/* States of a row reached for the first time with the same presses */
+typedef struct PathRow {
+    uint32_t columns;
+    uint16_t row;
+    uint16_t nb_presses;
+} PathRow;
+
+typedef struct PathSearch {
+    /* Places where the tetrimino locks, only once for the same cells */
+    int nb_ends;
+    PathEnd ends[PATH_NB_POSITIONS];
+
+    /* States reached, by phase, angle and y */
+    uint32_t visited[PATH_MAX_FALL_RATE * 4 * PATH_ROWS];
+
+    /* Only valid for the states reached */
+    uint32_t parent[PATH_NB_STATES];
+    uint8_t input[PATH_NB_STATES];
+
+    /* Rows of states by frame, then presses. Every one has at least one state
+     * reached for the first time */
+    PathRow queue[PATH_NB_STATES];
+
+    /* Columns where the shape of each angle fits, by y */
+    uint32_t fits[4][PATH_ROWS + 2];
+    int fall_rate;
+    int16_t end_index[PATH_NB_POSITIONS];
+} PathSearch;
+
+/*
+ * Find every place where the current tetrimino of a falling game can lock,
+ * from where it is now. Returns the number of ends. The PathSearch is big, it
+ * is better kept around than on the stack.
+ */
+int path_search(PathSearch* search, const Game* game);
+
+/* Fill inputs with one Input per frame to reach an end of the last search.
+ * Returns the number of frames */
+int path_inputs(const PathSearch* search, const PathEnd* end, Input inputs[PATH_MAX_FRAMES]);
+
+#endif
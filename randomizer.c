@@ -0,0 +1,514 @@
+/*
+ * Statistics of the piece generator over billions of pieces, on all cores.
+ *
+ *   ./tetris-randomizer [--pieces N] [--threads N] [--seed N] [--gap MIN[:MAX]]
+ *                       [--drought TYPE]
+ *
+ * Prints how often each piece comes, how often each one follows another, and
+ * how many pieces pass between two of the same type (droughts), with the
+ * distribution of the droughts of one type (I by default).
+ *
+ * In the game, the register of the generator also advances once per frame, so
+ * the pieces depend on how long each one took to place. Every piece is
+ * followed by a number of frames drawn between MIN and MAX (--gap, 30:60 by
+ * default, about what a piece takes at level 19 with the entry delay).
+ *
+ * Running randomizer_next_piece for every piece, and stepping the register
+ * for every frame, would be slow. Instead:
+ *
+ * - The register only has 32767 states, which follow each other in a single
+ *   cycle. A generator keeps its position in the cycle, and jumps ahead by a
+ *   whole gap at once.
+ *
+ * - A piece only depends on 4 bits of the register, the last 3 bits of the
+ *   spawn count and the previous piece. randomizer_next_piece is run once for
+ *   each of these cases to fill a table, so each piece is a lookup.
+ *
+ * Both are checked against the generator of the game stepped frame by frame
+ * before starting. Every worker then runs several streams at once, each with
+ * its own generator starting from another part of the cycle and its own gaps,
+ * so the lookups of one don't wait for the others.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core.h"
+
+#define MAX_THREADS 256
+
+/* Streams run at once by every worker */
+#define NB_LANES 8
+
+/* Longer droughts all go in the last bucket, and are only kept as a maximum */
+#define MAX_DROUGHT 1024
+
+/* Pieces checked against the generator of the game */
+#define NB_CHECKED_PIECES 100000
+
+/* Pieces are counted by their index in spawn_ids, 7 is before the first one */
+#define NO_PIECE 7
+
+/* Pieces by BlockType - 1 */
+static const char piece_names[7] = {'I', 'O', 'T', 'L', 'J', 'Z', 'S'};
+
+typedef struct StreamStats {
+    /* By previous and next piece */
+    long transitions[NO_PIECE + 1][7];
+
+    /* Pieces between two of the same type, by type */
+    long droughts[7][MAX_DROUGHT + 1];
+    long longest_drought[7];
+} StreamStats;
+
+typedef struct Lane {
+    /* Position of the register in the cycle */
+    int at;
+    uint8_t spawn_count;
+    int previous;
+
+    uint64_t gaps;
+
+    /* Index of the last piece of each type, -1 until one comes */
+    long last_seen[7];
+} Lane;
+
+typedef struct Stream {
+    int id;
+    long nb_pieces;
+    StreamStats stats;
+} Stream;
+
+long nb_pieces = 1000000000;
+int nb_threads = 0;
+uint16_t seed = RANDOMIZER_DEFAULT_SEED;
+int min_gap = 30;
+int max_gap = 60;
+int drought_type = BLOCK_TYPE_I;
+
+/* The states of the register in the order they come, and the 4 bits of each
+ * one which matter to pick a piece */
+uint16_t cycle[1 << 16];
+uint8_t cycle_bits[1 << 16];
+int period;
+
+/*
+ * The piece picked, by register bits, spawn count and previous piece, with
+ * PICK_REROLLED set if the register was advanced to pick it again.
+ */
+#define PICK_REROLLED 8
+uint8_t picks[16 * 8 * (NO_PIECE + 1)];
+
+Stream* streams;
+
+/* Bits 8 to 10 pick the piece, and bits 9 to 11 pick it again, once the
+ * register has moved by one */
+static inline int register_bits(uint16_t state)
+{
+    return (state >> 8) & 15;
+}
+
+static inline int pick_index(int bits, uint8_t spawn_count, int previous)
+{
+    return (bits * 8 + (spawn_count & 7)) * (NO_PIECE + 1) + previous;
+}
+
+static int spawn_index(BlockType type)
+{
+    for (int i = 0; i < 7; ++i)
+        if (spawn_types[i] == type)
+            return i;
+
+    return NO_PIECE;
+}
+
+static void build_tables()
+{
+    Randomizer randomizer;
+
+    randomizer_init(&randomizer, seed);
+    seed = randomizer.seed;
+    period = 0;
+
+    do {
+        cycle_bits[period] = register_bits(randomizer.seed);
+        cycle[period++] = randomizer.seed;
+        randomizer_step(&randomizer);
+    } while (randomizer.seed != cycle[0]);
+
+    for (int bits = 0; bits < 16; ++bits) {
+        for (int count = 0; count < 8; ++count) {
+            for (int previous = 0; previous <= NO_PIECE; ++previous) {
+                /* Bit 0 keeps the register from staying at 0 when stepped */
+                randomizer.seed = bits << 8 | 1;
+                randomizer.spawn_count = count - 1;
+                randomizer.spawn_id = (previous == NO_PIECE) ? 0 : spawn_ids[previous];
+
+                int piece = spawn_index(randomizer_next_piece(&randomizer));
+
+                picks[pick_index(bits, count, previous)] =
+                    piece | ((randomizer.seed != (bits << 8 | 1)) ? PICK_REROLLED : 0);
+            }
+        }
+    }
+}
+
+/* Gaps of every stream, independent of the generator of the game */
+static inline uint64_t xorshift(uint64_t* state)
+{
+    uint64_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+
+    return *state = x;
+}
+
+static uint64_t splitmix(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+
+    return x ^ (x >> 31);
+}
+
+static inline int next_gap(uint64_t* gaps)
+{
+    uint32_t range = max_gap - min_gap + 1;
+
+    return min_gap + (int)(((xorshift(gaps) >> 32) * range) >> 32);
+}
+
+static void lane_init(Lane* lane, int id, int nb_lanes)
+{
+    lane->at = (long)period * id / nb_lanes;
+    lane->spawn_count = 0;
+    lane->previous = NO_PIECE;
+    lane->gaps = splitmix((uint64_t)seed << 32 | id);
+
+    for (int t = 0; t < 7; ++t)
+        lane->last_seen[t] = -1;
+}
+
+/* Pick the next piece of a lane, the i-th one, then let the frames pass */
+static inline int lane_next_piece(Lane* lane)
+{
+    int pick = picks[pick_index(cycle_bits[lane->at], ++lane->spawn_count, lane->previous)];
+
+    lane->at += (pick >> 3) + next_gap(&lane->gaps);
+
+    if (lane->at >= period)
+        lane->at -= period;
+
+    return pick & 7;
+}
+
+static inline void count_piece(StreamStats* stats, Lane* lane, int piece, long i)
+{
+    ++stats->transitions[lane->previous][piece];
+    lane->previous = piece;
+
+    if (lane->last_seen[piece] >= 0) {
+        long drought = i - lane->last_seen[piece] - 1;
+
+        if (drought >= MAX_DROUGHT) {
+            if (drought > stats->longest_drought[piece])
+                stats->longest_drought[piece] = drought;
+
+            drought = MAX_DROUGHT;
+        }
+
+        ++stats->droughts[piece][drought];
+    }
+
+    lane->last_seen[piece] = i;
+}
+
+/* Returns false if the tables don't give the pieces of the game */
+static bool check_tables()
+{
+    Randomizer randomizer;
+    Lane lane;
+
+    randomizer_init(&randomizer, seed);
+    lane_init(&lane, 0, 1);
+
+    uint64_t gaps = lane.gaps;
+
+    for (int i = 0; i < NB_CHECKED_PIECES; ++i) {
+        int piece = spawn_index(randomizer_next_piece(&randomizer));
+
+        for (int frame = next_gap(&gaps); frame > 0; --frame)
+            randomizer_step(&randomizer);
+
+        if (lane_next_piece(&lane) != piece || cycle[lane.at] != randomizer.seed)
+            return false;
+
+        lane.previous = piece;
+    }
+
+    return true;
+}
+
+static void* run_stream(void* arg)
+{
+    Stream* stream = arg;
+    StreamStats* stats = &stream->stats;
+    Lane lanes[NB_LANES];
+
+    for (int l = 0; l < NB_LANES; ++l)
+        lane_init(&lanes[l], stream->id * NB_LANES + l, nb_threads * NB_LANES);
+
+    long nb_rounds = stream->nb_pieces / NB_LANES;
+
+    for (long i = 0; i < nb_rounds; ++i)
+        for (int l = 0; l < NB_LANES; ++l)
+            count_piece(stats, &lanes[l], lane_next_piece(&lanes[l]), i);
+
+    for (int l = 0; l < stream->nb_pieces % NB_LANES; ++l)
+        count_piece(stats, &lanes[l], lane_next_piece(&lanes[l]), nb_rounds);
+
+    return NULL;
+}
+
+static double now_s()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Smallest drought with at least a fraction of the droughts not longer */
+static long drought_percentile(const long counts[MAX_DROUGHT + 1], long total, double fraction)
+{
+    long sum = 0;
+
+    for (int d = 0; d < MAX_DROUGHT; ++d) {
+        sum += counts[d];
+
+        if (sum >= fraction * total)
+            return d;
+    }
+
+    return MAX_DROUGHT;
+}
+
+static char piece_name(int piece)
+{
+    return piece_names[spawn_types[piece] - 1];
+}
+
+static void print_summary(const StreamStats* stats, double elapsed)
+{
+    long counts[7] = {0};
+    long total = 0;
+
+    printf("%ld pieces on %d threads in %.2f s: %.1f M pieces/s\n", nb_pieces, nb_threads,
+           elapsed, nb_pieces / elapsed / 1e6);
+    printf("Seed 0x%04X, register period %d, %d to %d frames between pieces\n", seed, period,
+           min_gap, max_gap);
+
+    for (int a = 0; a <= NO_PIECE; ++a)
+        for (int b = 0; b < 7; ++b)
+            counts[b] += stats->transitions[a][b];
+
+    for (int t = 0; t < 7; ++t)
+        total += counts[t];
+
+    printf("\nPieces (%% of all, 14.29%% if uniform)\n");
+
+    for (int t = 0; t < 7; ++t)
+        printf("  %c %14ld  %6.3f%%\n", piece_name(t), counts[t], 100.0 * counts[t] / total);
+
+    printf("\nNext piece (%% of the pieces following the one on the left)\n   ");
+
+    for (int b = 0; b < 7; ++b)
+        printf("  %6c", piece_name(b));
+
+    printf("\n");
+
+    for (int a = 0; a < 7; ++a) {
+        long row = 0;
+
+        for (int b = 0; b < 7; ++b)
+            row += stats->transitions[a][b];
+
+        printf("  %c", piece_name(a));
+
+        for (int b = 0; b < 7; ++b)
+            printf("  %6.2f", row ? 100.0 * stats->transitions[a][b] / row : 0);
+
+        printf("\n");
+    }
+
+    printf("\nDroughts (pieces between two of the same type)\n");
+    printf("  %8s %6s %6s %6s %6s %8s\n", "mean", "p50", "p90", "p99", "p99.99", "max");
+
+    for (int t = 0; t < 7; ++t) {
+        const long* droughts = stats->droughts[t];
+        long nb_droughts = 0;
+        double sum = 0;
+        long longest = 0;
+
+        for (int d = 0; d <= MAX_DROUGHT; ++d) {
+            nb_droughts += droughts[d];
+            sum += (double)d * droughts[d];
+
+            if (droughts[d] > 0)
+                longest = d;
+        }
+
+        if (longest == MAX_DROUGHT)
+            longest = stats->longest_drought[t];
+
+        printf("  %c %8.2f %6ld %6ld %6ld %6ld %8ld\n", piece_name(t),
+               nb_droughts ? sum / nb_droughts : 0,
+               drought_percentile(droughts, nb_droughts, 0.5),
+               drought_percentile(droughts, nb_droughts, 0.9),
+               drought_percentile(droughts, nb_droughts, 0.99),
+               drought_percentile(droughts, nb_droughts, 0.9999), longest);
+    }
+
+    /* Chances to wait at least that many pieces for the next one */
+    static const int lengths[] = {1, 2, 5, 10, 15, 20, 25, 30, 40, 50, 60, 80, 100, 150, 200};
+    int piece = spawn_index(drought_type);
+    const long* droughts = stats->droughts[piece];
+    long nb_droughts = 0;
+
+    for (int d = 0; d <= MAX_DROUGHT; ++d)
+        nb_droughts += droughts[d];
+
+    printf("\nDroughts of %c\n", piece_name(piece));
+    printf("  %8s %14s %12s\n", "at least", "droughts", "fraction");
+
+    for (unsigned int l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l) {
+        long longer = 0;
+
+        for (int d = lengths[l]; d <= MAX_DROUGHT; ++d)
+            longer += droughts[d];
+
+        if (longer == 0)
+            break;
+
+        printf("  %8d %14ld %12.3g\n", lengths[l], longer, (double)longer / nb_droughts);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "--pieces") == 0)
+            nb_pieces = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "--threads") == 0)
+            nb_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0)
+            seed = strtol(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--gap") == 0) {
+            char* end;
+
+            min_gap = max_gap = strtol(argv[++i], &end, 10);
+
+            if (*end == ':')
+                max_gap = strtol(end + 1, NULL, 10);
+        } else if (strcmp(argv[i], "--drought") == 0) {
+            const char* name = memchr(piece_names, argv[++i][0], sizeof(piece_names));
+
+            if (name == NULL || argv[i][0] == '\0') {
+                fprintf(stderr, "Unknown piece %s, one of IOTLJZS\n", argv[i]);
+                return 1;
+            }
+
+            drought_type = name - piece_names + 1;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    build_tables();
+
+    /* Lanes move through the cycle by less than a whole turn per piece */
+    if (min_gap < 0 || max_gap < min_gap || max_gap >= period) {
+        fprintf(stderr, "Invalid gap %d:%d, gaps go from 0 to %d frames\n", min_gap, max_gap,
+                period - 1);
+        return 1;
+    }
+
+    if (nb_threads <= 0)
+        nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (nb_threads > MAX_THREADS)
+        nb_threads = MAX_THREADS;
+
+    if (nb_pieces <= 0)
+        return 0;
+
+    if (!check_tables()) {
+        fprintf(stderr, "The tables don't give the pieces of the game\n");
+        return 1;
+    }
+
+    streams = calloc(nb_threads, sizeof(Stream));
+
+    if (streams == NULL) {
+        fprintf(stderr, "Not enough memory for %d threads\n", nb_threads);
+        return 1;
+    }
+
+    for (int i = 0; i < nb_threads; ++i) {
+        streams[i].id = i;
+        streams[i].nb_pieces = nb_pieces * (i + 1) / nb_threads - nb_pieces * i / nb_threads;
+    }
+
+    pthread_t threads[MAX_THREADS];
+    double start = now_s();
+
+    for (int i = 0; i < nb_threads; ++i) {
+        if (pthread_create(&threads[i], NULL, run_stream, &streams[i]) != 0) {
+            fprintf(stderr, "Could not start %d threads\n", nb_threads);
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < nb_threads; ++i)
+        pthread_join(threads[i], NULL);
+
+    double elapsed = now_s() - start;
+
+    /* Add the streams up in the first one */
+    StreamStats* total = &streams[0].stats;
+
+    for (int i = 1; i < nb_threads; ++i) {
+        const StreamStats* stats = &streams[i].stats;
+
+        for (int a = 0; a <= NO_PIECE; ++a)
+            for (int b = 0; b < 7; ++b)
+                total->transitions[a][b] += stats->transitions[a][b];
+
+        for (int t = 0; t < 7; ++t) {
+            for (int d = 0; d <= MAX_DROUGHT; ++d)
+                total->droughts[t][d] += stats->droughts[t][d];
+
+            if (stats->longest_drought[t] > total->longest_drought[t])
+                total->longest_drought[t] = stats->longest_drought[t];
+        }
+    }
+
+    print_summary(total, elapsed);
+
+    free(streams);
+
+    return 0;
+}
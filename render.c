@@ -0,0 +1,431 @@
+#include "render.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include "ansi.h"
+
+RenderBackend render_backend = RENDER_BACKEND_NCURSES;
+
+/* Values used to center the tetrimino in the preview box */
+const char center_lengths[7] = {
+    5, // I
+    5, // O
+    4, // T
+    4, // L
+    4, // J
+    4, // Z
+    4, // S
+};
+
+const int curtain_frame_freq = 10;
+
+WINDOW* level_box;
+WINDOW* score_box;
+WINDOW* highscore_box;
+WINDOW* lines_box;
+WINDOW* game_box;
+WINDOW* pause_box;
+WINDOW* next_piece_box;
+WINDOW* frame_stats_box;
+WINDOW* hint_box;
+
+/* Where the hint puts the current piece */
+Placement hint_target;
+bool show_hint_target = false;
+
+/* What is currently on screen, to only draw what changed */
+unsigned char drawn_cells[WINDOW_HEIGHT][WINDOW_WIDTH];
+long drawn_score;
+long drawn_level;
+long drawn_lines;
+long drawn_highscore;
+BlockType drawn_next_type;
+
+bool init_render()
+{
+    if (render_backend == RENDER_BACKEND_ANSI)
+        return ansi_init(STDOUT_FILENO);
+
+    /* Initialize ncurses */
+    initscr();       // Initialize the window
+    noecho();        // Don't echo the key presses
+    curs_set(false); // Don't display the cursor
+    cbreak();        // Get input character by character
+
+    init_windows();
+
+    return true;
+}
+
+void init_windows()
+{
+    start_color();   // Use colors
+
+    /* Initialize the colors */
+    use_default_colors();
+    init_pair(1, COLOR_CYAN, -1);     /* I tetrimino */
+    init_pair(2, COLOR_YELLOW, -1);   /* O tetrimino */
+    init_pair(3, COLOR_MAGENTA, -1);  /* T tetrimino */
+    init_pair(4, -1, -1);             /* L tetrimino */  /* foreground color */
+    init_pair(5, COLOR_BLUE, -1);     /* J tetrimino */
+    init_pair(6, COLOR_RED, -1);      /* Z tetrimino */
+    init_pair(7, COLOR_GREEN, -1);    /* S tetrimino */
+
+    /* Initialize game window */
+    game_box = subwin(stdscr, WINDOW_HEIGHT + 2, 2*WINDOW_WIDTH + 2, 0, 0);
+    box(game_box, ACS_VLINE, ACS_HLINE);
+    wrefresh(game_box);
+    keypad(game_box, true); // Enable arrow keys
+
+    /* Initialize level window */
+    level_box = subwin(stdscr, 1 + 2, WINDOW_WIDTH + 2, 2, 2*WINDOW_WIDTH + 2);
+    box(level_box, ACS_VLINE, ACS_HLINE);
+    wrefresh(level_box);
+
+    /* Initialize lines window */
+    lines_box = subwin(stdscr, 1 + 2, WINDOW_WIDTH + 2, 5, 2*WINDOW_WIDTH + 2);
+    box(lines_box, ACS_VLINE, ACS_HLINE);
+    wrefresh(lines_box);
+
+    /* Initialize next piece window */
+    next_piece_box = subwin(stdscr, 2 + 2, WINDOW_WIDTH + 2, 9, 2*WINDOW_WIDTH + 2);
+    box(next_piece_box, ACS_VLINE, ACS_HLINE);
+    wrefresh(next_piece_box);
+
+    /* Initialize score window */
+    score_box = subwin(stdscr, 1 + 2, WINDOW_WIDTH + 2, 14, 2*WINDOW_WIDTH + 2);
+    box(score_box, ACS_VLINE, ACS_HLINE);
+    wrefresh(score_box);
+
+    /* Initialize highscore window */
+    highscore_box = subwin(stdscr, 1 + 2, WINDOW_WIDTH + 2, 17, 2*WINDOW_WIDTH + 2);
+    box(highscore_box, ACS_VLINE, ACS_HLINE);
+    wrefresh(highscore_box);
+
+    /* Initialize the frame timings window, only drawn when asked */
+    frame_stats_box = subwin(stdscr, NB_FRAME_PHASES + 3, 34, 14, 3*WINDOW_WIDTH + 4);
+
+    /* Initialize the hint window, only drawn when asked */
+    hint_box = subwin(stdscr, 2 + 2, 34, 2, 3*WINDOW_WIDTH + 4);
+
+    /* Initialize pause window */
+    pause_box = subwin(stdscr, 3, 8, WINDOW_HEIGHT / 2, 7);
+    box(pause_box, ACS_VLINE, ACS_HLINE);
+    wrefresh(pause_box);
+
+    invalidate_screen();
+}
+
+void deinit_render()
+{
+    if (render_backend == RENDER_BACKEND_ANSI) {
+        ansi_deinit();
+        return;
+    }
+
+    /* Close ncurses */
+    endwin();
+}
+
+/* Each "pixel" is two characters wide */
+void print_pixel(int x, int y, WINDOW* window)
+{
+    if (y >= 0) {
+        mvwaddch(window, 1+y, 1+2*x, ACS_BLOCK);
+        mvwaddch(window, 1+y, 2+2*x, ACS_BLOCK);
+    }
+}
+
+void print_shiny_pixel(int x, int y, WINDOW* window)
+{
+    if (y >= 0) {
+        mvwaddch(window, 1+y, 1+2*x, ACS_CKBOARD);
+        mvwaddch(window, 1+y, 2+2*x, ACS_CKBOARD);
+    }
+}
+
+void invalidate_screen()
+{
+    if (render_backend == RENDER_BACKEND_ANSI) {
+        ansi_invalidate();
+        return;
+    }
+
+    memset(drawn_cells, CELL_UNKNOWN, sizeof(drawn_cells));
+
+    drawn_score = -1;
+    drawn_level = -1;
+    drawn_lines = -1;
+    drawn_highscore = -1;
+    drawn_next_type = BLOCK_TYPE_NONE;
+
+    box(game_box, ACS_VLINE, ACS_HLINE);
+    wnoutrefresh(game_box);
+}
+
+void compose_game(const Game* game, unsigned char cells[WINDOW_HEIGHT][WINDOW_WIDTH])
+{
+    /* The vanishing zone is not drawn */
+    memcpy(cells, game->board.colors[BOARD_TOP], WINDOW_HEIGHT * sizeof(cells[0]));
+
+    if (game->state == GAME_STATE_FALLING && show_hint_target) {
+        for (int i = 0; i < 4; ++i) {
+            int x = hint_target.x + shapes[hint_target.shape_number][i][0];
+            int y = hint_target.y + shapes[hint_target.shape_number][i][1];
+
+            if (y >= 0 && cells[y][x] == BLOCK_TYPE_NONE)
+                cells[y][x] = CELL_GHOST;
+        }
+    }
+
+    if (game->state == GAME_STATE_FALLING) {
+        const Tetrimino* ctetr = &game->ctetr;
+
+        for (int i = 0; i < 4; ++i) {
+            int x = ctetr->x + shapes[ctetr->shape_number][i][0];
+            int y = ctetr->y + shapes[ctetr->shape_number][i][1];
+
+            if (y >= 0)
+                cells[y][x] = ctetr->type;
+        }
+    }
+
+    /* Highlight the lines about to be removed */
+    if (game->state == GAME_STATE_LINE_CLEAR)
+        for (int i = 0; i < game->nb_completed_lines; ++i)
+            if (game->completed_lines[i] >= 0)
+                memset(cells[game->completed_lines[i]], CELL_HIGHLIGHT, WINDOW_WIDTH);
+}
+
+/* Draw len cells of the same kind starting at (x, y), with one call */
+void display_run(int x, int y, int len, unsigned char cell)
+{
+    chtype run[2*WINDOW_WIDTH];
+    chtype pixel;
+
+    if (cell == BLOCK_TYPE_NONE)
+        pixel = ' ';
+    else if (cell == CELL_HIGHLIGHT)
+        pixel = ACS_CKBOARD;
+    else
+        pixel = ACS_BLOCK | COLOR_PAIR(cell);
+
+    for (int i = 0; i < 2*len; ++i)
+        run[i] = pixel;
+
+    if (cell == CELL_GHOST)
+        for (int i = 0; i < 2*len; ++i)
+            run[i] = (i % 2) ? ']' : '[';
+
+    mvwaddchnstr(game_box, 1+y, 1+2*x, run, 2*len);
+}
+
+/*
+ * The board is walked once, and each horizontal run of changed cells of the
+ * same color is drawn with a single call. This changes the attributes at most
+ * once per run rather than once per color, see bench.c for the comparison with
+ * looping over the board for each color.
+ */
+void display_cells(const unsigned char cells[WINDOW_HEIGHT][WINDOW_WIDTH])
+{
+    bool changed = false;
+
+    for (int y = 0; y < WINDOW_HEIGHT; ++y) {
+        int x = 0;
+
+        while (x < WINDOW_WIDTH) {
+            if (cells[y][x] == drawn_cells[y][x]) {
+                ++x;
+                continue;
+            }
+
+            int start = x;
+            unsigned char cell = cells[y][x];
+
+            while (x < WINDOW_WIDTH && cells[y][x] == cell && drawn_cells[y][x] != cell)
+                drawn_cells[y][x++] = cell;
+
+            display_run(start, y, x - start, cell);
+            changed = true;
+        }
+    }
+
+    if (changed)
+        wnoutrefresh(game_box);
+}
+
+void display_game(const Game* game)
+{
+    unsigned char cells[WINDOW_HEIGHT][WINDOW_WIDTH];
+
+    compose_game(game, cells);
+    display_cells(cells);
+}
+
+/* Draw one of the boxes showing a number, if it changed */
+void display_counter(WINDOW* window, const char* title, long value, long* drawn_value)
+{
+    if (value == *drawn_value)
+        return;
+
+    box(window, ACS_VLINE, ACS_HLINE);
+    mvwprintw(window, 0, 1, "%s", title);
+    mvwprintw(window, 1, 1, "%-*ld", WINDOW_WIDTH, value);
+
+    *drawn_value = value;
+    wnoutrefresh(window);
+}
+
+void display_next_piece(const Game* game)
+{
+    const Tetrimino* ntetr = &game->ntetr;
+
+    if (ntetr->type == drawn_next_type)
+        return;
+
+    werase(next_piece_box);
+    box(next_piece_box, ACS_VLINE, ACS_HLINE);
+    mvwprintw(next_piece_box, 0, 1, "Next");
+
+    int center_length = center_lengths[ntetr->type - 1];
+
+    wattron(next_piece_box, COLOR_PAIR(ntetr->type));
+
+    for (int i = 0; i < 4; ++i) {
+        int x = shapes[ntetr->shape_number][i][0];
+        int y = shapes[ntetr->shape_number][i][1];
+
+        mvwaddch(next_piece_box, 1+y, 1 + center_length + 2*x, ACS_BLOCK);
+        mvwaddch(next_piece_box, 1+y, 2 + center_length + 2*x, ACS_BLOCK);
+    }
+
+    wattroff(next_piece_box, COLOR_PAIR(ntetr->type));
+
+    drawn_next_type = ntetr->type;
+    wnoutrefresh(next_piece_box);
+}
+
+/* Only what changed since the last frame is drawn, and sent to the terminal
+ * all at once */
+void draw_game(const Game* game, long highscore)
+{
+    if (render_backend == RENDER_BACKEND_ANSI) {
+        ansi_draw_game(game, highscore);
+        return;
+    }
+
+    display_game(game);
+    display_counter(score_box, "Score", game->score, &drawn_score);
+    display_counter(level_box, "Level", game->level, &drawn_level);
+    display_next_piece(game);
+    display_counter(highscore_box, "Highscore", highscore, &drawn_highscore);
+    display_counter(lines_box, "Lines", game->cleared_lines, &drawn_lines);
+
+    doupdate();
+}
+
+void draw_falling_curtain(int nb_frames)
+{
+    if (render_backend == RENDER_BACKEND_ANSI) {
+        ansi_draw_falling_curtain(nb_frames);
+        return;
+    }
+
+    wattron(game_box, COLOR_PAIR(4));
+
+    for (int j = 0; j < nb_frames / curtain_frame_freq; ++j)
+        for (int i = 0; i < WINDOW_WIDTH; ++i)
+            print_shiny_pixel(i, j, game_box);
+
+    wattroff(game_box, COLOR_PAIR(4));
+    wrefresh(game_box);
+}
+
+void draw_pause()
+{
+    if (render_backend == RENDER_BACKEND_ANSI) {
+        ansi_draw_pause();
+        return;
+    }
+
+    box(pause_box, ACS_VLINE, ACS_HLINE);
+    mvwprintw(pause_box, 1, 1, "Paused");
+
+    wrefresh(pause_box);
+}
+
+void draw_frame_stats(const PhaseSummary summaries[NB_FRAME_PHASES], int nb_frames)
+{
+    if (render_backend == RENDER_BACKEND_ANSI) {
+        ansi_draw_frame_stats(summaries, nb_frames);
+        return;
+    }
+
+    if (frame_stats_box == NULL)
+        return;
+
+    werase(frame_stats_box);
+    box(frame_stats_box, ACS_VLINE, ACS_HLINE);
+    mvwprintw(frame_stats_box, 0, 1, "Frame times (us, %d frames)", nb_frames);
+    mvwprintw(frame_stats_box, 1, 1, "%-6s %7s %7s %7s", "", "p50", "p99", "max");
+
+    for (int phase = 0; phase < NB_FRAME_PHASES; ++phase)
+        mvwprintw(frame_stats_box, 2 + phase, 1, "%-6s %7.1f %7.1f %7.1f",
+                  frame_phase_names[phase], summaries[phase].p50_ns / 1e3,
+                  summaries[phase].p99_ns / 1e3, summaries[phase].max_ns / 1e3);
+
+    wnoutrefresh(frame_stats_box);
+}
+
+void hide_frame_stats()
+{
+    if (render_backend == RENDER_BACKEND_ANSI) {
+        ansi_hide_frame_stats();
+        return;
+    }
+
+    if (frame_stats_box == NULL)
+        return;
+
+    werase(frame_stats_box);
+    wnoutrefresh(frame_stats_box);
+}
+
+void draw_hint(const Placement* target, const char* inputs, int nb_frames, int nb_presses)
+{
+    hint_target = *target;
+    show_hint_target = true;
+
+    if (render_backend == RENDER_BACKEND_ANSI) {
+        ansi_draw_hint(inputs, nb_frames, nb_presses);
+        return;
+    }
+
+    if (hint_box == NULL)
+        return;
+
+    werase(hint_box);
+    box(hint_box, ACS_VLINE, ACS_HLINE);
+    mvwprintw(hint_box, 0, 1, "Hint");
+    mvwprintw(hint_box, 1, 1, "%.32s", inputs);
+    mvwprintw(hint_box, 2, 1, "%d frames, %d presses", nb_frames, nb_presses);
+
+    wnoutrefresh(hint_box);
+}
+
+void hide_hint()
+{
+    show_hint_target = false;
+
+    if (render_backend == RENDER_BACKEND_ANSI) {
+        ansi_hide_hint();
+        return;
+    }
+
+    if (hint_box == NULL)
+        return;
+
+    werase(hint_box);
+    wnoutrefresh(hint_box);
+}
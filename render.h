@@ -0,0 +1,90 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+/*
+ * ncurses rendering of a game.
+ *
+ * The renderer remembers what it drew, so every draw only sends to the
+ * terminal what changed since the last frame.
+ *
+ * The functions drawing whole frames can also go through the ANSI backend
+ * (see ansi.h) instead, which sends the frame without ncurses.
+ */
+
+#include <ncurses.h>
+
+#include "ai.h"
+#include "core.h"
+#include "frame_stats.h"
+
+/* Value of a cell of a line about to be removed, next to the BlockTypes */
+#define CELL_HIGHLIGHT 8
+
+/* Empty cell where the hint puts the current piece */
+#define CELL_GHOST 9
+#define CELL_UNKNOWN 0xFF
+
+typedef enum RenderBackend {
+    RENDER_BACKEND_NCURSES,
+    RENDER_BACKEND_ANSI,
+} RenderBackend;
+
+/* To be chosen before init_render */
+extern RenderBackend render_backend;
+
+/* The number of frame every step of the curtain animation will last */
+extern const int curtain_frame_freq;
+
+/* Values used to center the tetrimino in the preview box, by type - 1 */
+extern const char center_lengths[7];
+
+extern WINDOW* level_box;
+extern WINDOW* score_box;
+extern WINDOW* highscore_box;
+extern WINDOW* lines_box;
+extern WINDOW* game_box;
+extern WINDOW* pause_box;
+extern WINDOW* next_piece_box;
+
+/* Frame timings, NULL if the terminal is too small to show them */
+extern WINDOW* frame_stats_box;
+
+/* Inputs of the hint, NULL if the terminal is too small to show them */
+extern WINDOW* hint_box;
+
+/* Set up ncurses, its colors and the windows, or the ANSI backend. Returns
+ * false if the terminal could not be set up */
+bool init_render();
+void deinit_render();
+
+/* Only set up the colors and the windows, for an already started terminal */
+void init_windows();
+
+void print_pixel(int x, int y, WINDOW* window);
+void print_shiny_pixel(int x, int y, WINDOW* window);
+
+/* Fill the cells of the game box as they should appear this frame */
+void compose_game(const Game* game, unsigned char cells[WINDOW_HEIGHT][WINDOW_WIDTH]);
+
+/* Draw the cells of the game box that changed since the last frame */
+void display_cells(const unsigned char cells[WINDOW_HEIGHT][WINDOW_WIDTH]);
+void display_game(const Game* game);
+
+/* Forget what is on screen, so the next frame is drawn entirely */
+void invalidate_screen();
+
+void draw_game(const Game* game, long highscore);
+void draw_falling_curtain(int nb_frames);
+void draw_pause();
+
+/* Show the percentiles of the frame timings next to the highscore, sent to
+ * the terminal with the next frame */
+void draw_frame_stats(const PhaseSummary summaries[NB_FRAME_PHASES], int nb_frames);
+void hide_frame_stats();
+
+/* Show where the current piece could go under it, with the inputs to get
+ * there, until hide_hint. Drawn with the next frame */
+void draw_hint(const Placement* target, const char* inputs, int nb_frames, int nb_presses);
+void hide_hint();
+
+#endif
@@ -0,0 +1,203 @@
+#include "replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char replay_magic[4] = {'T', 'T', 'R', 'P'};
+
+#define HEADER_SIZE 18
+#define V1_HEADER_SIZE 16
+
+void replay_init(Replay* replay, uint16_t seed, int start_level)
+{
+    memset(replay, 0, sizeof(*replay));
+
+    replay->seed = seed;
+    replay->start_level = start_level;
+}
+
+void replay_free(Replay* replay)
+{
+    free(replay->data);
+    replay->data = NULL;
+}
+
+static void push_byte(Replay* replay, unsigned char byte)
+{
+    if (replay->size == replay->capacity) {
+        replay->capacity = (replay->capacity > 0) ? 2 * replay->capacity : 4096;
+        replay->data = realloc(replay->data, replay->capacity);
+
+        if (replay->data == NULL) {
+            fprintf(stderr, "Out of memory while recording the replay\n");
+            exit(1);
+        }
+    }
+
+    replay->data[replay->size++] = byte;
+}
+
+static void push_run(Replay* replay)
+{
+    if (replay->run_length == 0)
+        return;
+
+    push_byte(replay, replay->run_input);
+
+    /* Runs are never empty, so store the length minus one */
+    unsigned long length = replay->run_length - 1;
+
+    do {
+        unsigned char byte = length & 0x7F;
+        length >>= 7;
+        push_byte(replay, byte | (length ? 0x80 : 0));
+    } while (length);
+
+    replay->run_length = 0;
+}
+
+void replay_record(Replay* replay, Input input)
+{
+    if (replay->run_length > 0 && input != replay->run_input)
+        push_run(replay);
+
+    replay->run_input = input;
+    ++replay->run_length;
+    ++replay->nb_frames;
+}
+
+void replay_finish(Replay* replay, long score)
+{
+    push_run(replay);
+    replay->score = score;
+}
+
+static void write_le(unsigned char* out, unsigned long value, int nb_bytes)
+{
+    for (int i = 0; i < nb_bytes; ++i)
+        out[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static unsigned long read_le(const unsigned char* in, int nb_bytes)
+{
+    unsigned long value = 0;
+
+    for (int i = 0; i < nb_bytes; ++i)
+        value |= (unsigned long)in[i] << (8 * i);
+
+    return value;
+}
+
+bool replay_save(const Replay* replay, const char* path)
+{
+    unsigned char header[HEADER_SIZE];
+
+    memcpy(header, replay_magic, 4);
+    header[4] = REPLAY_VERSION;
+    header[5] = replay->start_level;
+    write_le(header + 6, replay->seed, 2);
+    write_le(header + 8, replay->nb_frames, 4);
+    write_le(header + 12, replay->score, 4);
+    header[16] = WINDOW_WIDTH;
+    header[17] = WINDOW_HEIGHT;
+
+    FILE* file = fopen(path, "wb");
+
+    if (file == NULL)
+        return false;
+
+    bool ok = fwrite(header, 1, HEADER_SIZE, file) == HEADER_SIZE
+        && fwrite(replay->data, 1, replay->size, file) == replay->size;
+
+    return (fclose(file) == 0) && ok;
+}
+
+bool replay_load(Replay* replay, const char* path)
+{
+    unsigned char header[HEADER_SIZE];
+    FILE* file = fopen(path, "rb");
+
+    if (file == NULL)
+        return false;
+
+    if (fread(header, 1, V1_HEADER_SIZE, file) != V1_HEADER_SIZE
+        || memcmp(header, replay_magic, 4) != 0
+        || (header[4] != 1 && header[4] != REPLAY_VERSION)) {
+        fclose(file);
+        return false;
+    }
+
+    if (header[4] == 1) {
+        header[16] = 10;
+        header[17] = 20;
+    } else if (fread(header + V1_HEADER_SIZE, 1, 2, file) != 2) {
+        fclose(file);
+        return false;
+    }
+
+    if (header[16] != WINDOW_WIDTH || header[17] != WINDOW_HEIGHT) {
+        fclose(file);
+        return false;
+    }
+
+    replay_init(replay, read_le(header + 6, 2), header[5]);
+    replay->nb_frames = read_le(header + 8, 4);
+    replay->score = read_le(header + 12, 4);
+
+    int byte;
+
+    while ((byte = fgetc(file)) != EOF)
+        push_byte(replay, byte);
+
+    fclose(file);
+
+    return true;
+}
+
+bool replay_next_input(Replay* replay, Input* input)
+{
+    if (replay->run_length == 0) {
+        if (replay->read_pos >= replay->size)
+            return false;
+
+        replay->run_input = replay->data[replay->read_pos++];
+
+        unsigned long length = 0;
+        int shift = 0;
+        unsigned char byte;
+
+        do {
+            /* A corrupt replay, longer than any length fits */
+            if (replay->read_pos >= replay->size || shift >= 8 * (int)sizeof(length))
+                return false;
+
+            byte = replay->data[replay->read_pos++];
+            length |= (unsigned long)(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        /* No run is longer than the whole replay */
+        if (length >= (unsigned long)replay->nb_frames)
+            return false;
+
+        replay->run_length = length + 1;
+    }
+
+    --replay->run_length;
+    *input = replay->run_input;
+
+    return true;
+}
+
+bool replay_simulate(Replay* replay, Game* game)
+{
+    Input input;
+
+    game_init(game, replay->start_level, replay->seed);
+
+    while (replay_next_input(replay, &input))
+        game_step(game, input);
+
+    return game->score == replay->score;
+}
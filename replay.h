@@ -0,0 +1,72 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+/*
+ * Recording and playback of games.
+ *
+ * As the game only depends on its seed, its start level and the inputs of
+ * every frame, that is all a replay holds. Inputs are run length encoded, so
+ * the long runs of frames without any input take a couple of bytes.
+ *
+ * File format, little endian:
+ *   "TTRP", version (1 byte), start level (1 byte), seed (2 bytes),
+ *   number of frames (4 bytes), final score (4 bytes),
+ *   board width (1 byte), board height (1 byte),
+ *   then runs of: input (1 byte), run length - 1 (LEB128).
+ *
+ * Version 1 has no board size, its games are played on a 10x20 board. A replay
+ * only loads in a build for the same board size.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "core.h"
+
+#define REPLAY_VERSION 2
+
+typedef struct Replay {
+    uint16_t seed;
+    int start_level;
+
+    long nb_frames;
+
+    /* Score at the end of the recording */
+    long score;
+
+    /* Encoded runs of inputs */
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+
+    /* Run being recorded, or being played back */
+    Input run_input;
+    long run_length;
+
+    /* Playback position in data */
+    size_t read_pos;
+} Replay;
+
+void replay_init(Replay* replay, uint16_t seed, int start_level);
+void replay_free(Replay* replay);
+
+/* Add the input of one frame to the recording */
+void replay_record(Replay* replay, Input input);
+
+/* End the recording with the final score of the game */
+void replay_finish(Replay* replay, long score);
+
+bool replay_save(const Replay* replay, const char* path);
+
+/* Returns false if the file can't be read or isn't a valid replay */
+bool replay_load(Replay* replay, const char* path);
+
+/* Get the input of the next frame. Returns false once all frames are played */
+bool replay_next_input(Replay* replay, Input* input);
+
+/* Play the whole replay on a new game as fast as possible, without drawing.
+ * Returns true if the game ends with the recorded score */
+bool replay_simulate(Replay* replay, Game* game);
+
+#endif
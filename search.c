@@ -0,0 +1,557 @@
+#include "search.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "eval.h"
+
+const SearchLimits search_default_limits = {
+    .depth = 3,
+    .beam_width = 16,
+    .nb_threads = 1,
+    .max_nodes = 0,
+
+    /* Leaves most of a frame to draw */
+    .max_time_ns = 10000000,
+};
+
+/* Pieces placed at most: the two known ones and the sampled ones */
+#define MAX_DEPTH 8
+
+/* Entries of the table of each thread, a power of 2 */
+#define TABLE_SIZE (1 << 14)
+
+/* The rows which can hold blocks */
+#define HASHED_ROWS (BOARD_TOP + WINDOW_HEIGHT)
+
+/* The playable columns of a row */
+#define INTERIOR ((BoardRow)~EMPTY_ROW)
+
+/*
+ * Zobrist keys of each possible byte of each row, so a board is hashed a byte
+ * at a time rather than a cell at a time. Empty bytes have a key of 0, so the
+ * empty rows at the top of the board don't change the hash.
+ */
+static uint64_t zobrist_keys[HASHED_ROWS][sizeof(BoardRow)][256];
+static pthread_once_t zobrist_once = PTHREAD_ONCE_INIT;
+
+/* A node of the tree: a board after placing some pieces */
+typedef struct Node {
+    BoardRow rows[BOARD_ROWS];
+    uint64_t hash;
+
+    /* Lines cleared since the first placement */
+    int lines;
+
+    /* Score of the board alone, and with the lines */
+    double board_score;
+    double score;
+} Node;
+
+/* What is known of a board, for the thread which met it */
+typedef struct TableEntry {
+    uint64_t hash;
+
+    /* Score of the board alone, without the cleared lines */
+    double board_score;
+
+    /* The move where the board was scored, the entry is empty for the others */
+    unsigned int generation;
+
+    /* The beam level where the board was last generated, and its index there */
+    unsigned int stamp;
+    int node;
+} TableEntry;
+
+typedef struct Worker {
+    Search* search;
+    pthread_t thread;
+
+    Node* beam;
+    Node* candidates;
+    TableEntry* table;
+    unsigned int stamp;
+    EvalBatch batch;
+
+    long nb_cache_hits;
+    long nb_transpositions;
+} Worker;
+
+struct Search {
+    SearchLimits limits;
+    const AiWeights* weights;
+
+    /* Moves chosen so far, tagging the table entries of each one */
+    unsigned int generation;
+
+    int nb_workers;
+    Worker* workers;
+
+    /*
+     * The threads of the workers but the first, which is run by the caller,
+     * wait for the next iteration of the deepening. The caller waits for
+     * nb_running to go back to 0.
+     */
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned int iteration;
+    int nb_running;
+    bool stopping;
+
+    /* Type of the piece placed at each depth */
+    BlockType pieces[MAX_DEPTH];
+
+    /* Depth of the current iteration */
+    int depth;
+
+    /* The placements of the current tetrimino, split between the threads */
+    Placement placements[AI_MAX_PLACEMENTS];
+    Node roots[AI_MAX_PLACEMENTS];
+    double root_scores[AI_MAX_PLACEMENTS];
+    int nb_roots;
+    atomic_int next_root;
+
+    atomic_long nb_nodes;
+    atomic_bool out_of_budget;
+    long deadline_ns;
+};
+
+/* Zeroed memory, running out of it is fatal as for the replays */
+static void* allocate(size_t size)
+{
+    void* memory = calloc(1, size);
+
+    if (memory == NULL) {
+        fprintf(stderr, "Out of memory while creating the search\n");
+        exit(1);
+    }
+
+    return memory;
+}
+
+static uint64_t splitmix64(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+
+    return z ^ (z >> 31);
+}
+
+static void init_zobrist_keys()
+{
+    uint64_t state = 0;
+
+    for (int y = 0; y < HASHED_ROWS; ++y)
+        for (int i = 0; i < (int)sizeof(BoardRow); ++i)
+            for (int byte = 1; byte < 256; ++byte)
+                zobrist_keys[y][i][byte] = splitmix64(&state);
+}
+
+static uint64_t hash_rows(const BoardRow rows[BOARD_ROWS])
+{
+    uint64_t hash = 0;
+
+    for (int y = 0; y < HASHED_ROWS; ++y) {
+        BoardRow row = rows[y] & INTERIOR;
+
+        for (int i = 0; i < (int)sizeof(BoardRow); ++i)
+            hash ^= zobrist_keys[y][i][(row >> (8 * i)) & 0xFF];
+    }
+
+    return hash;
+}
+
+static long now_ns()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+/* Account for new nodes, returns true if the search must stop */
+static bool out_of_budget(Search* search, long nb_new_nodes)
+{
+    const SearchLimits* limits = &search->limits;
+    long nb_nodes = atomic_fetch_add(&search->nb_nodes, nb_new_nodes) + nb_new_nodes;
+
+    if ((limits->max_nodes > 0 && nb_nodes > limits->max_nodes)
+            || (limits->max_time_ns > 0 && now_ns() > search->deadline_ns))
+        atomic_store(&search->out_of_budget, true);
+
+    return atomic_load(&search->out_of_budget);
+}
+
+/*
+ * Place the piece in every possible way on the boards of the beam. Boards
+ * reached more than once are only kept once, with the most lines cleared, and
+ * lost ones are dropped. The boards not in the table are scored together, a
+ * beam node at a time. Returns the number of candidates, or -1 if the budget
+ * ran out.
+ */
+static int expand(Worker* worker, const Node* beam, int nb_beam, BlockType type)
+{
+    const AiWeights* weights = worker->search->weights;
+    Tetrimino tetrimino = make_new_tetrimino(type);
+    unsigned int generation = worker->search->generation;
+    unsigned int stamp = ++worker->stamp;
+    int nb_candidates = 0;
+
+    for (int i = 0; i < nb_beam; ++i) {
+        Placement placements[AI_MAX_PLACEMENTS];
+        int nb_placements = ai_generate_placements(beam[i].rows, &tetrimino, placements);
+
+        /* Candidates whose score is not known yet */
+        int unscored[AI_MAX_PLACEMENTS];
+        int zero_lines[AI_MAX_PLACEMENTS] = {0};
+        double scores[AI_MAX_PLACEMENTS];
+
+        eval_batch_clear(&worker->batch);
+
+        for (int j = 0; j < nb_placements; ++j) {
+            const Placement* p = &placements[j];
+            Node* node = &worker->candidates[nb_candidates];
+
+            memcpy(node->rows, beam[i].rows, sizeof(node->rows));
+            rows_add_shape(node->rows, p->x, p->y, p->shape_number);
+            node->lines = beam[i].lines + rows_clear_lines(node->rows);
+            node->hash = hash_rows(node->rows);
+
+            TableEntry* entry = &worker->table[node->hash & (TABLE_SIZE - 1)];
+            bool known = entry->hash == node->hash && entry->generation == generation;
+
+            if (known && entry->stamp == stamp) {
+                Node* other = &worker->candidates[entry->node];
+
+                ++worker->nb_transpositions;
+
+                if (node->lines > other->lines)
+                    other->lines = node->lines;
+
+                continue;
+            }
+
+            if (known) {
+                ++worker->nb_cache_hits;
+                node->board_score = entry->board_score;
+            } else {
+                unscored[eval_batch_add(&worker->batch, node->rows)] = nb_candidates;
+                entry->hash = node->hash;
+                entry->generation = generation;
+            }
+
+            entry->stamp = stamp;
+            entry->node = nb_candidates;
+            ++nb_candidates;
+        }
+
+        eval_batch_scores(&worker->batch, zero_lines, weights, scores);
+
+        for (int j = 0; j < worker->batch.nb_boards; ++j) {
+            Node* node = &worker->candidates[unscored[j]];
+            TableEntry* entry = &worker->table[node->hash & (TABLE_SIZE - 1)];
+
+            node->board_score = scores[j];
+
+            /* Unless another board took the entry since */
+            if (entry->hash == node->hash && entry->generation == generation)
+                entry->board_score = scores[j];
+        }
+
+        if (out_of_budget(worker->search, nb_placements))
+            return -1;
+    }
+
+    /* Only score the candidates now that all their lines are known */
+    int nb_kept = 0;
+
+    for (int i = 0; i < nb_candidates; ++i) {
+        Node* node = &worker->candidates[i];
+
+        if (node->board_score <= AI_LOST_SCORE)
+            continue;
+
+        node->score = node->board_score + weights->lines * node->lines;
+        worker->candidates[nb_kept++] = *node;
+    }
+
+    return nb_kept;
+}
+
+static int compare_nodes(const void* a, const void* b)
+{
+    double score_a = ((const Node*)a)->score;
+    double score_b = ((const Node*)b)->score;
+
+    return (score_a < score_b) - (score_a > score_b);
+}
+
+/* Best score reachable below a placement of the current tetrimino */
+static double search_root(Worker* worker, const Node* root)
+{
+    Search* search = worker->search;
+    int beam_width = search->limits.beam_width;
+    int nb_beam = 1;
+
+    worker->beam[0] = *root;
+
+    for (int depth = 1; depth < search->depth; ++depth) {
+        int nb_candidates = expand(worker, worker->beam, nb_beam, search->pieces[depth]);
+
+        /* Out of budget, or every placement loses */
+        if (nb_candidates <= 0)
+            return AI_LOST_SCORE;
+
+        qsort(worker->candidates, nb_candidates, sizeof(Node), compare_nodes);
+
+        nb_beam = (nb_candidates < beam_width) ? nb_candidates : beam_width;
+        memcpy(worker->beam, worker->candidates, nb_beam * sizeof(Node));
+    }
+
+    return worker->beam[0].score;
+}
+
+static void* search_worker(void* arg)
+{
+    Worker* worker = arg;
+    Search* search = worker->search;
+    int i;
+
+    while (!atomic_load(&search->out_of_budget)
+            && (i = atomic_fetch_add(&search->next_root, 1)) < search->nb_roots)
+        search->root_scores[i] = search_root(worker, &search->roots[i]);
+
+    return NULL;
+}
+
+static void* pool_thread(void* arg)
+{
+    Worker* worker = arg;
+    Search* search = worker->search;
+    unsigned int iteration = 0;
+
+    pthread_mutex_lock(&search->lock);
+
+    for (;;) {
+        while (search->iteration == iteration && !search->stopping)
+            pthread_cond_wait(&search->start, &search->lock);
+
+        if (search->stopping)
+            break;
+
+        iteration = search->iteration;
+        pthread_mutex_unlock(&search->lock);
+
+        search_worker(worker);
+
+        pthread_mutex_lock(&search->lock);
+
+        if (--search->nb_running == 0)
+            pthread_cond_signal(&search->done);
+    }
+
+    pthread_mutex_unlock(&search->lock);
+
+    return NULL;
+}
+
+/* Search the roots at the current depth on every worker */
+static void run_iteration(Search* search)
+{
+    atomic_store(&search->next_root, 0);
+
+    pthread_mutex_lock(&search->lock);
+    search->nb_running = search->nb_workers - 1;
+    ++search->iteration;
+    pthread_cond_broadcast(&search->start);
+    pthread_mutex_unlock(&search->lock);
+
+    search_worker(&search->workers[0]);
+
+    pthread_mutex_lock(&search->lock);
+
+    while (search->nb_running > 0)
+        pthread_cond_wait(&search->done, &search->lock);
+
+    pthread_mutex_unlock(&search->lock);
+}
+
+Search* search_create(const SearchLimits* limits)
+{
+    Search* search = allocate(sizeof(Search));
+
+    pthread_once(&zobrist_once, init_zobrist_keys);
+
+    search->limits = *limits;
+
+    if (search->limits.beam_width <= 0)
+        search->limits.beam_width = 1;
+
+    int beam_width = search->limits.beam_width;
+    int nb_workers = (limits->nb_threads > 0) ? limits->nb_threads : 1;
+
+    search->workers = allocate(nb_workers * sizeof(Worker));
+
+    pthread_mutex_init(&search->lock, NULL);
+    pthread_cond_init(&search->start, NULL);
+    pthread_cond_init(&search->done, NULL);
+
+    for (int i = 0; i < nb_workers; ++i) {
+        Worker* worker = &search->workers[i];
+
+        worker->search = search;
+        worker->beam = allocate(beam_width * sizeof(Node));
+        worker->candidates = allocate(beam_width * AI_MAX_PLACEMENTS * sizeof(Node));
+        worker->table = allocate(TABLE_SIZE * sizeof(TableEntry));
+    }
+
+    /* Fewer threads only make the search shallower */
+    search->nb_workers = 1;
+
+    while (search->nb_workers < nb_workers
+            && pthread_create(&search->workers[search->nb_workers].thread, NULL, pool_thread,
+                              &search->workers[search->nb_workers]) == 0)
+        ++search->nb_workers;
+
+    for (int i = search->nb_workers; i < nb_workers; ++i) {
+        free(search->workers[i].beam);
+        free(search->workers[i].candidates);
+        free(search->workers[i].table);
+    }
+
+    return search;
+}
+
+void search_destroy(Search* search)
+{
+    pthread_mutex_lock(&search->lock);
+    search->stopping = true;
+    pthread_cond_broadcast(&search->start);
+    pthread_mutex_unlock(&search->lock);
+
+    for (int i = 1; i < search->nb_workers; ++i)
+        pthread_join(search->workers[i].thread, NULL);
+
+    for (int i = 0; i < search->nb_workers; ++i) {
+        free(search->workers[i].beam);
+        free(search->workers[i].candidates);
+        free(search->workers[i].table);
+    }
+
+    pthread_mutex_destroy(&search->lock);
+    pthread_cond_destroy(&search->start);
+    pthread_cond_destroy(&search->done);
+
+    free(search->workers);
+    free(search);
+}
+
+/* Returns the index of the best root, or -1 if they are all lost */
+static int best_root(const Search* search)
+{
+    int best = -1;
+
+    for (int i = 0; i < search->nb_roots; ++i)
+        if (search->root_scores[i] > AI_LOST_SCORE
+                && (best < 0 || search->root_scores[i] > search->root_scores[best]))
+            best = i;
+
+    return best;
+}
+
+bool search_choose_placement(Search* search, const Game* game, const AiWeights* weights,
+                             Placement* best, SearchStats* stats)
+{
+    const SearchLimits* limits = &search->limits;
+    long start = now_ns();
+
+    search->weights = weights;
+    ++search->generation;
+    atomic_init(&search->nb_nodes, 0);
+    atomic_init(&search->out_of_budget, false);
+    search->deadline_ns = start + limits->max_time_ns;
+
+    for (int i = 0; i < search->nb_workers; ++i) {
+        search->workers[i].nb_cache_hits = 0;
+        search->workers[i].nb_transpositions = 0;
+    }
+
+    /* Sample the pieces after the next one from a copy of the generator */
+    int max_depth = (limits->depth < MAX_DEPTH) ? limits->depth : MAX_DEPTH;
+    Randomizer randomizer = game->randomizer;
+
+    search->pieces[0] = game->ctetr.type;
+    search->pieces[1] = game->ntetr.type;
+
+    for (int depth = 2; depth < max_depth; ++depth) {
+        randomizer_step(&randomizer);
+        search->pieces[depth] = randomizer_next_piece(&randomizer);
+    }
+
+    /* The first level is searched entirely */
+    search->nb_roots = ai_generate_placements(game->board.rows, &game->ctetr, search->placements);
+
+    for (int i = 0; i < search->nb_roots; ++i) {
+        const Placement* p = &search->placements[i];
+        Node* root = &search->roots[i];
+
+        memcpy(root->rows, game->board.rows, sizeof(root->rows));
+        rows_add_shape(root->rows, p->x, p->y, p->shape_number);
+        root->lines = rows_clear_lines(root->rows);
+        root->hash = hash_rows(root->rows);
+        root->score = ai_evaluate(root->rows, root->lines, weights);
+        search->root_scores[i] = root->score;
+    }
+
+    atomic_fetch_add(&search->nb_nodes, search->nb_roots);
+
+    int chosen = best_root(search);
+    int depth_reached = 1;
+
+    /* Even a lost placement is better than none */
+    if (chosen < 0 && search->nb_roots > 0)
+        chosen = 0;
+
+    /* Deepen one piece at a time, only keeping complete iterations */
+    for (int depth = 2; depth <= max_depth && chosen >= 0; ++depth) {
+        search->depth = depth;
+        run_iteration(search);
+
+        if (atomic_load(&search->out_of_budget))
+            break;
+
+        int deeper_choice = best_root(search);
+
+        /* Every placement loses, deeper won't tell them apart */
+        if (deeper_choice < 0)
+            break;
+
+        chosen = deeper_choice;
+        depth_reached = depth;
+    }
+
+    if (chosen >= 0)
+        *best = search->placements[chosen];
+
+    if (stats != NULL) {
+        stats->nb_nodes = atomic_load(&search->nb_nodes);
+        stats->nb_cache_hits = 0;
+        stats->nb_transpositions = 0;
+        stats->depth_reached = depth_reached;
+
+        for (int i = 0; i < search->nb_workers; ++i) {
+            stats->nb_cache_hits += search->workers[i].nb_cache_hits;
+            stats->nb_transpositions += search->workers[i].nb_transpositions;
+        }
+
+        stats->elapsed_ns = now_ns() - start;
+    }
+
+    return chosen >= 0;
+}
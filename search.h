@@ -0,0 +1,70 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+/*
+ * A deeper search for the bot, placing more than the two known pieces.
+ *
+ * The first level of the tree is every placement of the current tetrimino,
+ * split between threads. Below each of them, a beam search keeps the best
+ * boards after placing the next tetrimino, then pieces sampled from a copy of
+ * the piece generator. Boards reached twice at the same depth, by placing the
+ * same pieces in another order or place, are only expanded once, and board
+ * scores are cached, both through a hash of the rows.
+ *
+ * The search deepens one piece at a time until it reaches its depth or runs
+ * out of nodes or time, and answers with the deepest level it could complete,
+ * so it can run within a frame.
+ *
+ * The sampled pieces are only a guess, as the generator also advances every
+ * frame, so going deeper than one of them tends to plan for pieces which
+ * never come.
+ */
+
+#include <stdbool.h>
+
+#include "ai.h"
+#include "core.h"
+
+typedef struct SearchLimits {
+    /* Number of pieces placed, at least 1. The first two are the current and
+     * next tetriminos, the others are sampled */
+    int depth;
+
+    /* Boards kept at each depth below a placement of the current tetrimino */
+    int beam_width;
+
+    int nb_threads;
+
+    /* Budget of the whole search, 0 for no limit */
+    long max_nodes;
+    long max_time_ns;
+} SearchLimits;
+
+extern const SearchLimits search_default_limits;
+
+typedef struct SearchStats {
+    long nb_nodes;          /* Boards generated */
+    long nb_cache_hits;     /* Boards whose score was already known */
+    long nb_transpositions; /* Boards already reached at the same depth */
+    int depth_reached;      /* Deepest level completed within the budget */
+    long elapsed_ns;
+} SearchStats;
+
+typedef struct Search Search;
+
+/*
+ * The threads, tables and buffers of a search with these limits, made once and
+ * reused for every move, so a move only pays for the search itself. Exits if
+ * out of memory.
+ */
+Search* search_create(const SearchLimits* limits);
+void search_destroy(Search* search);
+
+/*
+ * Returns false if the current tetrimino can't be placed anywhere. stats can be
+ * NULL. A search is used by one thread at a time.
+ */
+bool search_choose_placement(Search* search, const Game* game, const AiWeights* weights,
+                             Placement* best, SearchStats* stats);
+
+#endif
@@ -0,0 +1,666 @@
+/*
+ * Host many games in a single process, played from thin terminal clients.
+ *
+ *   ./tetris-server <socket> [--sessions N] [--threads N] [--bots N] [--level N]
+ *                   [--stats S]
+ *
+ * and to play, from any terminal of the machine:
+ *
+ *   ./tetris --connect <socket> [level]
+ *
+ * Every game is a session taken from a pool allocated at startup, holding the
+ * Game, the controller turning the keys of its client into buttons, and what
+ * is queued for the client. A client sends its start level, then the keys it
+ * reads, and gets its game back as the stream of keyframes and deltas used
+ * for spectators (see spectator.h), which it only has to draw.
+ *
+ * Sessions are ticked at 60 Hz from a timer wheel with one slot per frame:
+ * the sessions of the current slot are split between a small pool of threads,
+ * then put back in the slot of their next tick, the next frame while playing
+ * and a few frames later while paused.
+ *
+ * --bots adds sessions played by the AI, which start a new game when they
+ * lose, to see how many games the machine can host. The time and memory used
+ * per session are printed every --stats seconds, and on exit.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ai.h"
+#include "core.h"
+#include "frame_clock.h"
+#include "keyboard.h"
+#include "spectator.h"
+
+#define MAX_THREADS 256
+
+/* Run at around 60 fps, in nanoseconds, like the game */
+#define TICK_NS 16640000
+
+/* A power of 2, longer than the longest delay between two ticks */
+#define WHEEL_SLOTS 16
+
+/* The game only looks for the end of a pause every 10 frames too */
+#define PAUSED_TICKS 10
+
+/* Keys received which wait for a later frame */
+#define SESSION_MAX_KEYS 32
+
+/* Frames a finished game waits for its last frames to be sent */
+#define LINGER_TICKS 60
+
+typedef struct PendingKey {
+    unsigned char key;
+    long long time_ns;
+} PendingKey;
+
+typedef struct Session {
+    /* Next session in the free list, or in the same slot of the wheel */
+    struct Session* next;
+
+    Game game;
+    Controller controller;
+    uint16_t seed;
+
+    /* The client sent its start level */
+    bool started;
+    bool paused;
+
+    /* To be given back to the pool after this tick */
+    bool over;
+    int nb_linger_ticks;
+
+    /* Ticks until the next one, set by every tick */
+    int delay;
+
+    /* Played by the AI, without a client */
+    bool is_bot;
+    AiPlayer ai;
+
+    SpectatorClient client;
+    SpectatorFrame last_sent;
+    bool has_sent;
+
+    PendingKey keys[SESSION_MAX_KEYS];
+    int nb_keys;
+
+    unsigned char buffer[SPECTATOR_BUFFER_SIZE];
+} Session;
+
+typedef struct TimerWheel {
+    Session* slots[WHEEL_SLOTS];
+    unsigned long tick;
+} TimerWheel;
+
+const char* socket_path;
+int nb_sessions = 256;
+int nb_threads = 0;
+int nb_bots = 0;
+int bot_level = 0;
+int stats_period_s = 10;
+
+Session* pool;
+Session* free_sessions;
+int nb_active_sessions = 0;
+int nb_active_bots = 0;
+
+TimerWheel wheel;
+int listen_fd = -1;
+
+volatile sig_atomic_t stop = 0;
+
+/* The sessions of the current tick, taken in turn by the threads */
+Session** due_sessions;
+int nb_due_sessions;
+atomic_int next_due_session;
+long long tick_start_ns;
+bool stopping = false;
+
+pthread_barrier_t tick_begin;
+pthread_barrier_t tick_end;
+
+/* Best score of the games being played, shown to everyone as the highscore */
+atomic_long best_score;
+
+/* Statistics since the last report */
+atomic_llong cpu_ns;
+atomic_long nb_bytes;
+atomic_long nb_overflows;
+long nb_ticks = 0;
+long nb_session_ticks = 0;
+long long total_tick_ns = 0;
+long long max_tick_ns = 0;
+long nb_connections = 0;
+long nb_rejected = 0;
+
+static long long clock_ns(clockid_t clock)
+{
+    struct timespec t;
+    clock_gettime(clock, &t);
+    return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static void wheel_schedule(TimerWheel* wheel, Session* session, int delay)
+{
+    Session** slot = &wheel->slots[(wheel->tick + delay) & (WHEEL_SLOTS - 1)];
+
+    session->next = *slot;
+    *slot = session;
+}
+
+/* Take the sessions to tick now, and move on to the next frame */
+static Session* wheel_advance(TimerWheel* wheel)
+{
+    Session** slot = &wheel->slots[wheel->tick & (WHEEL_SLOTS - 1)];
+    Session* due = *slot;
+
+    *slot = NULL;
+    ++wheel->tick;
+
+    return due;
+}
+
+static Session* take_session()
+{
+    Session* session = free_sessions;
+
+    if (session == NULL)
+        return NULL;
+
+    free_sessions = session->next;
+    memset(session, 0, offsetof(Session, buffer));
+
+    session->seed = time(NULL) ^ (session - pool) ^ (nb_connections << 8);
+    session->client.fd = -1;
+    session->client.buffer = session->buffer;
+    session->client.needs_keyframe = true;
+    controller_init(&session->controller);
+
+    ++nb_active_sessions;
+
+    return session;
+}
+
+static void release_session(Session* session)
+{
+    if (session->client.fd >= 0)
+        close(session->client.fd);
+
+    session->client.fd = -1;
+
+    if (session->is_bot)
+        --nb_active_bots;
+
+    --nb_active_sessions;
+
+    session->next = free_sessions;
+    free_sessions = session;
+}
+
+static void add_bot()
+{
+    Session* session = take_session();
+
+    if (session == NULL)
+        return;
+
+    session->is_bot = true;
+    session->started = true;
+    ai_player_init(&session->ai, &ai_default_weights);
+    game_init(&session->game, bot_level, session->seed);
+
+    ++nb_active_bots;
+
+    /* Spread over the next frames, so they don't all lock pieces together */
+    wheel_schedule(&wheel, session, 1 + nb_active_bots % (WHEEL_SLOTS - 1));
+}
+
+static void accept_clients()
+{
+    int fd;
+
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+        Session* session = take_session();
+
+        if (session == NULL) {
+            ++nb_rejected;
+            close(fd);
+            continue;
+        }
+
+        int socket_buffer_size = SPECTATOR_BUFFER_SIZE;
+
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &socket_buffer_size, sizeof(socket_buffer_size));
+
+        session->client.fd = fd;
+        ++nb_connections;
+
+        wheel_schedule(&wheel, session, 1);
+    }
+}
+
+/* Read what the client sent, returns false once it left */
+static bool read_keys(Session* session, long long now)
+{
+    unsigned char bytes[64];
+    ssize_t size;
+
+    while ((size = recv(session->client.fd, bytes, sizeof(bytes), MSG_DONTWAIT)) > 0) {
+        for (ssize_t i = 0; i < size; ++i) {
+            /* The first byte is the level to start at */
+            if (!session->started) {
+                game_init(&session->game, bytes[i], session->seed);
+                session->started = true;
+            } else if (session->nb_keys < SESSION_MAX_KEYS) {
+                session->keys[session->nb_keys++] = (PendingKey){ bytes[i], now };
+            }
+        }
+    }
+
+    return size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+}
+
+/* Like the game, keys other than p are ignored during a pause, and a second
+ * press of a button waits for the next frame */
+static void handle_keys(Session* session, long long now)
+{
+    int i;
+
+    for (i = 0; i < session->nb_keys; ++i) {
+        int key = session->keys[i].key;
+
+        if (session->paused) {
+            if (key == 'p') {
+                session->paused = false;
+                controller_init(&session->controller);
+            }
+        } else if (key == 'p') {
+            session->paused = true;
+        } else {
+            Input button = key_button(key);
+
+            if (button != INPUT_NONE && !controller_event(&session->controller, button,
+                                                          session->keys[i].time_ns, now))
+                break;
+        }
+    }
+
+    session->nb_keys -= i;
+    memmove(session->keys, &session->keys[i], session->nb_keys * sizeof(session->keys[0]));
+}
+
+static void send_frame(Session* session)
+{
+    SpectatorClient* client = &session->client;
+    SpectatorFrame frame = {
+        .game = session->game,
+        .highscore = atomic_load_explicit(&best_score, memory_order_relaxed),
+        .paused = session->paused,
+    };
+    unsigned char message[SPECTATOR_MAX_MESSAGE_SIZE];
+
+    int size = session->has_sent
+        ? spectator_encode_message(&session->last_sent, &frame, message) : 0;
+
+    if (size > 0 || client->needs_keyframe) {
+        bool keyframe = spectator_client_needs_keyframe(client, size);
+
+        if (keyframe) {
+            if (!client->needs_keyframe)
+                atomic_fetch_add_explicit(&nb_overflows, 1, memory_order_relaxed);
+
+            size = spectator_encode_message(NULL, &frame, message);
+        }
+
+        spectator_client_queue(client, message, size, keyframe);
+    }
+
+    long sent = spectator_client_send(client);
+
+    if (sent < 0)
+        session->over = true;
+    else if (sent > 0)
+        atomic_fetch_add_explicit(&nb_bytes, sent, memory_order_relaxed);
+
+    session->last_sent = frame;
+    session->has_sent = true;
+}
+
+static void update_best_score(long score)
+{
+    long best = atomic_load_explicit(&best_score, memory_order_relaxed);
+
+    while (score > best && !atomic_compare_exchange_weak(&best_score, &best, score))
+        ;
+}
+
+static void tick_session(Session* session, long long now)
+{
+    session->delay = 1;
+
+    if (!session->is_bot && !read_keys(session, now)) {
+        session->over = true;
+        return;
+    }
+
+    if (!session->started)
+        return;
+
+    handle_keys(session, now);
+
+    if (!session->paused && session->game.state != GAME_STATE_OVER) {
+        Input input = session->is_bot ? ai_player_input(&session->ai, &session->game)
+                                      : controller_frame(&session->controller, now);
+
+        game_step(&session->game, input);
+        update_best_score(session->game.score);
+    }
+
+    if (session->paused)
+        session->delay = PAUSED_TICKS;
+
+    if (session->is_bot) {
+        if (session->game.state == GAME_STATE_OVER)
+            game_init(&session->game, bot_level, ++session->seed);
+        return;
+    }
+
+    send_frame(session);
+
+    /* The client goes on to the game over animation once it got everything */
+    if (session->game.state == GAME_STATE_OVER
+            && (session->client.length == 0 || ++session->nb_linger_ticks > LINGER_TICKS))
+        session->over = true;
+}
+
+/* Tick the sessions of this frame with the other threads */
+static void work()
+{
+    long long start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    int i;
+
+    while ((i = atomic_fetch_add(&next_due_session, 1)) < nb_due_sessions)
+        tick_session(due_sessions[i], tick_start_ns);
+
+    atomic_fetch_add(&cpu_ns, clock_ns(CLOCK_THREAD_CPUTIME_ID) - start);
+}
+
+static void* worker(void* arg)
+{
+    (void)arg;
+
+    for (;;) {
+        pthread_barrier_wait(&tick_begin);
+
+        if (stopping)
+            return NULL;
+
+        work();
+        pthread_barrier_wait(&tick_end);
+    }
+}
+
+static void tick()
+{
+    nb_due_sessions = 0;
+
+    for (Session* session = wheel_advance(&wheel); session != NULL; session = session->next)
+        due_sessions[nb_due_sessions++] = session;
+
+    tick_start_ns = clock_ns(CLOCK_MONOTONIC);
+    atomic_store(&next_due_session, 0);
+
+    pthread_barrier_wait(&tick_begin);
+    work();
+    pthread_barrier_wait(&tick_end);
+
+    long long tick_ns = clock_ns(CLOCK_MONOTONIC) - tick_start_ns;
+
+    /* Sessions go back to the pool or to the wheel from this thread only */
+    for (int i = 0; i < nb_due_sessions; ++i) {
+        Session* session = due_sessions[i];
+
+        if (session->over)
+            release_session(session);
+        else
+            wheel_schedule(&wheel, session, session->delay);
+    }
+
+    ++nb_ticks;
+    nb_session_ticks += nb_due_sessions;
+    total_tick_ns += tick_ns;
+
+    if (tick_ns > max_tick_ns)
+        max_tick_ns = tick_ns;
+}
+
+static long resident_bytes()
+{
+    long size, resident = 0;
+    FILE* file = fopen("/proc/self/statm", "r");
+
+    if (file != NULL) {
+        if (fscanf(file, "%ld %ld", &size, &resident) != 2)
+            resident = 0;
+
+        fclose(file);
+    }
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static void print_stats(const FrameClock* clock, double elapsed_s)
+{
+    long long total_cpu_ns = atomic_exchange(&cpu_ns, 0);
+
+    printf("%d sessions (%d bots), %zu bytes each, %.1f MB resident\n",
+           nb_active_sessions, nb_active_bots, sizeof(Session), resident_bytes() / 1e6);
+
+    if (nb_ticks > 0)
+        printf("  Tick: %.1f us mean, %.1f us max, %.2f us of CPU per session, "
+               "%ld late of %ld\n", total_tick_ns / 1e3 / nb_ticks, max_tick_ns / 1e3,
+               nb_session_ticks ? total_cpu_ns / 1e3 / nb_session_ticks : 0.0,
+               clock->nb_late_frames, clock->nb_frames);
+
+    printf("  Clients: %ld connected, %ld turned away, %.1f kB/s sent, %ld too far behind\n",
+           nb_connections, nb_rejected,
+           atomic_exchange(&nb_bytes, 0) / 1e3 / elapsed_s,
+           atomic_exchange(&nb_overflows, 0));
+
+    fflush(stdout);
+
+    nb_ticks = 0;
+    nb_session_ticks = 0;
+    total_tick_ns = 0;
+    max_tick_ns = 0;
+}
+
+static void handle_signal(int signal_number)
+{
+    (void)signal_number;
+    stop = 1;
+}
+
+/* A socket left by a server which didn't stop cleanly can be replaced, not
+ * one still in use */
+static void remove_stale_socket(const struct sockaddr_un* address)
+{
+    struct stat st;
+
+    if (lstat(address->sun_path, &st) != 0 || !S_ISSOCK(st.st_mode))
+        return;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd < 0)
+        return;
+
+    if (connect(fd, (const struct sockaddr*)address, sizeof(*address)) != 0
+            && errno == ECONNREFUSED)
+        unlink(address->sun_path);
+
+    close(fd);
+}
+
+/* Fails if another server is listening on the path */
+static bool listen_on(const char* path)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+    if (strlen(path) >= sizeof(address.sun_path))
+        return false;
+
+    strcpy(address.sun_path, path);
+    remove_stale_socket(&address);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    return listen_fd >= 0
+        && bind(listen_fd, (const struct sockaddr*)&address, sizeof(address)) == 0
+        && listen(listen_fd, SOMAXCONN) == 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argv[1][0] == '-') {
+        fprintf(stderr, "Usage: %s <socket> [--sessions N] [--threads N] [--bots N] "
+                "[--level N] [--stats S]\n", argv[0]);
+        return 1;
+    }
+
+    socket_path = argv[1];
+
+    for (int i = 2; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", argv[i]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "--sessions") == 0)
+            nb_sessions = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0)
+            nb_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--bots") == 0)
+            nb_bots = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--level") == 0)
+            bot_level = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--stats") == 0)
+            stats_period_s = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (nb_threads <= 0)
+        nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (nb_threads > MAX_THREADS)
+        nb_threads = MAX_THREADS;
+
+    if (nb_sessions < 1)
+        nb_sessions = 1;
+
+    pool = calloc(nb_sessions, sizeof(Session));
+    due_sessions = calloc(nb_sessions, sizeof(Session*));
+
+    if (pool == NULL || due_sessions == NULL) {
+        fprintf(stderr, "Not enough memory for %d sessions\n", nb_sessions);
+        return 1;
+    }
+
+    for (int i = nb_sessions - 1; i >= 0; --i) {
+        pool[i].client.fd = -1;
+        pool[i].next = free_sessions;
+        free_sessions = &pool[i];
+    }
+
+    if (!listen_on(socket_path)) {
+        fprintf(stderr, "Could not listen on %s: %s\n", socket_path, strerror(errno));
+        return 1;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < nb_bots; ++i)
+        add_bot();
+
+    pthread_barrier_init(&tick_begin, NULL, nb_threads);
+    pthread_barrier_init(&tick_end, NULL, nb_threads);
+
+    pthread_t threads[MAX_THREADS];
+
+    /* The barriers wait for every thread, a tick would never end without one */
+    for (int i = 1; i < nb_threads; ++i) {
+        if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+            fprintf(stderr, "Could not start %d threads\n", nb_threads);
+            close(listen_fd);
+            unlink(socket_path);
+            return 1;
+        }
+    }
+
+    printf("Hosting up to %d games on %s with %d threads\n", nb_sessions, socket_path,
+           nb_threads);
+
+    FrameClock clock;
+    long long last_report_ns = clock_ns(CLOCK_MONOTONIC);
+
+    frame_clock_init(&clock, TICK_NS);
+
+    while (!stop) {
+        accept_clients();
+        tick();
+
+        /* Sessions are only late as a whole, their frames are all caught up */
+        while (!stop && frame_clock_is_late(&clock))
+            tick();
+
+        long long now = clock_ns(CLOCK_MONOTONIC);
+
+        if (stats_period_s > 0 && now - last_report_ns >= stats_period_s * 1000000000LL) {
+            print_stats(&clock, (now - last_report_ns) * 1e-9);
+            last_report_ns = now;
+        }
+
+        frame_clock_wait(&clock);
+    }
+
+    stopping = true;
+    pthread_barrier_wait(&tick_begin);
+
+    for (int i = 1; i < nb_threads; ++i)
+        pthread_join(threads[i], NULL);
+
+    print_stats(&clock, (clock_ns(CLOCK_MONOTONIC) - last_report_ns) * 1e-9);
+
+    for (int i = 0; i < nb_sessions; ++i)
+        if (pool[i].client.fd >= 0)
+            close(pool[i].client.fd);
+
+    close(listen_fd);
+    unlink(socket_path);
+
+    pthread_barrier_destroy(&tick_begin);
+    pthread_barrier_destroy(&tick_end);
+    free(due_sessions);
+    free(pool);
+
+    return 0;
+}
@@ -0,0 +1,803 @@
+#include "spectator.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MESSAGE_KEYFRAME 'K'
+#define MESSAGE_DELTA 'D'
+
+/* Fields of a message, in the order they come when present */
+#define FIELD_PIECE     (1 << 0)
+#define FIELD_NEXT      (1 << 1)
+#define FIELD_STATE     (1 << 2)
+#define FIELD_SCORE     (1 << 3)
+#define FIELD_COUNTERS  (1 << 4)
+#define FIELD_HIGHSCORE (1 << 5)
+#define FIELD_ROWS      (1 << 6)
+#define ALL_FIELDS      0x7F
+
+#if 2 * SPECTATOR_MAX_MESSAGE_SIZE > SPECTATOR_BUFFER_SIZE
+#error "The spectator buffers are too small for this board"
+#endif
+
+#define MAX_EVENTS 16
+
+static unsigned char* put_u8(unsigned char* p, unsigned int value)
+{
+    *p = value;
+    return p + 1;
+}
+
+static unsigned char* put_u16(unsigned char* p, unsigned int value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+
+    return p + 2;
+}
+
+static unsigned char* put_u32(unsigned char* p, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        p[i] = value >> (8 * i);
+
+    return p + 4;
+}
+
+static unsigned char* put_u64(unsigned char* p, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+        p[i] = value >> (8 * i);
+
+    return p + 8;
+}
+
+static bool same_tetrimino(const Tetrimino* a, const Tetrimino* b)
+{
+    return a->x == b->x && a->y == b->y && a->type == b->type && a->angle == b->angle;
+}
+
+static bool same_state(const SpectatorFrame* a, const SpectatorFrame* b)
+{
+    return a->game.state == b->game.state && a->paused == b->paused
+        && a->game.nb_completed_lines == b->game.nb_completed_lines
+        && memcmp(a->game.completed_lines, b->game.completed_lines,
+                  sizeof(a->game.completed_lines)) == 0;
+}
+
+int spectator_encode_message(const SpectatorFrame* old, const SpectatorFrame* frame,
+                             unsigned char message[SPECTATOR_MAX_MESSAGE_SIZE])
+{
+    const Game* game = &frame->game;
+    unsigned char* p = message + 2;
+
+    p = put_u8(p, (old == NULL) ? MESSAGE_KEYFRAME : MESSAGE_DELTA);
+
+    if (old == NULL) {
+        p = put_u8(p, WINDOW_WIDTH);
+        p = put_u8(p, WINDOW_HEIGHT);
+    }
+
+    unsigned char* fields = p;
+    p = put_u8(p, 0);
+
+    if (old == NULL || !same_tetrimino(&old->game.ctetr, &game->ctetr)) {
+        *fields |= FIELD_PIECE;
+        p = put_u8(p, game->ctetr.x);
+        p = put_u16(p, game->ctetr.y);
+        p = put_u8(p, game->ctetr.type);
+        p = put_u8(p, game->ctetr.angle);
+    }
+
+    if (old == NULL || !same_tetrimino(&old->game.ntetr, &game->ntetr)) {
+        *fields |= FIELD_NEXT;
+        p = put_u8(p, game->ntetr.type);
+        p = put_u8(p, game->ntetr.angle);
+    }
+
+    if (old == NULL || !same_state(old, frame)) {
+        *fields |= FIELD_STATE;
+        p = put_u8(p, game->state);
+        p = put_u8(p, frame->paused);
+        p = put_u8(p, game->nb_completed_lines);
+
+        for (int i = 0; i < 4; ++i)
+            p = put_u16(p, game->completed_lines[i]);
+    }
+
+    if (old == NULL || old->game.score != game->score) {
+        *fields |= FIELD_SCORE;
+        p = put_u64(p, game->score);
+    }
+
+    if (old == NULL || old->game.level != game->level
+            || old->game.cleared_lines != game->cleared_lines) {
+        *fields |= FIELD_COUNTERS;
+        p = put_u32(p, game->level);
+        p = put_u32(p, game->cleared_lines);
+    }
+
+    if (old == NULL || old->highscore != frame->highscore) {
+        *fields |= FIELD_HIGHSCORE;
+        p = put_u64(p, frame->highscore);
+    }
+
+    /* Only the rows which changed, the board does only when a piece locks */
+    int changed_rows[WINDOW_HEIGHT];
+    int nb_changed_rows = 0;
+
+    for (int y = 0; y < WINDOW_HEIGHT; ++y)
+        if (old == NULL || memcmp(old->game.board.colors[BOARD_TOP + y],
+                                  game->board.colors[BOARD_TOP + y], WINDOW_WIDTH) != 0)
+            changed_rows[nb_changed_rows++] = y;
+
+    if (nb_changed_rows > 0) {
+        *fields |= FIELD_ROWS;
+        p = put_u8(p, nb_changed_rows);
+
+        for (int i = 0; i < nb_changed_rows; ++i) {
+            p = put_u8(p, changed_rows[i]);
+            memcpy(p, game->board.colors[BOARD_TOP + changed_rows[i]], WINDOW_WIDTH);
+            p += WINDOW_WIDTH;
+        }
+    }
+
+    if (*fields == 0)
+        return 0;
+
+    int size = p - message;
+    message[0] = (size - 2) & 0xFF;
+    message[1] = (size - 2) >> 8;
+
+    return size;
+}
+
+/* Size of the message at the start of a buffer, length included */
+static int message_size(const unsigned char* message)
+{
+    return 2 + (message[0] | message[1] << 8);
+}
+
+/* Latest frame of the game. Returns false if nothing was published yet */
+static bool read_published(SpectatorServer* server, SpectatorFrame* frame)
+{
+    for (;;) {
+        unsigned int before = atomic_load_explicit(&server->sequence, memory_order_acquire);
+
+        /* The game is writing it, and may have been preempted doing so */
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+
+        *frame = server->published;
+        atomic_thread_fence(memory_order_acquire);
+
+        if (atomic_load_explicit(&server->sequence, memory_order_relaxed) == before)
+            return before != 0;
+    }
+}
+
+static void close_client(SpectatorServer* server, SpectatorClient* client)
+{
+    close(client->fd);
+    free(client->buffer);
+
+    client->fd = -1;
+    client->buffer = NULL;
+    atomic_fetch_sub(&server->nb_clients, 1);
+}
+
+static void watch_writable(SpectatorServer* server, SpectatorClient* client, bool writing)
+{
+    if (client->writing == writing)
+        return;
+
+    struct epoll_event event = {
+        .events = EPOLLIN | (writing ? EPOLLOUT : 0),
+        .data.ptr = client,
+    };
+
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+    client->writing = writing;
+}
+
+long spectator_client_send(SpectatorClient* client)
+{
+    long nb_bytes = 0;
+
+    while (client->sent < client->length) {
+        ssize_t size = send(client->fd, client->buffer + client->sent,
+                            client->length - client->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (size < 0 && errno == EINTR)
+            continue;
+
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+
+        if (size < 0)
+            return -1;
+
+        client->sent += size;
+        nb_bytes += size;
+    }
+
+    /* Keep the buffer starting with the message being sent */
+    int done = 0;
+
+    while (done < client->length && done + message_size(client->buffer + done) <= client->sent)
+        done += message_size(client->buffer + done);
+
+    memmove(client->buffer, client->buffer + done, client->length - done);
+    client->length -= done;
+    client->sent -= done;
+
+    return nb_bytes;
+}
+
+bool spectator_client_needs_keyframe(const SpectatorClient* client, int size)
+{
+    return client->needs_keyframe || client->length + size > SPECTATOR_BUFFER_SIZE;
+}
+
+void spectator_client_queue(SpectatorClient* client, const unsigned char* message, int size,
+                            bool keyframe)
+{
+    /* Only the message being sent has to go through */
+    if (keyframe) {
+        client->length = (client->sent > 0) ? message_size(client->buffer) : 0;
+        client->needs_keyframe = false;
+    }
+
+    memcpy(client->buffer + client->length, message, size);
+    client->length += size;
+}
+
+/* Send what the socket takes, and wait for it to be writable again for the
+ * rest */
+static void flush_client(SpectatorServer* server, SpectatorClient* client)
+{
+    long nb_bytes = spectator_client_send(client);
+
+    if (nb_bytes < 0) {
+        close_client(server, client);
+        return;
+    }
+
+    server->nb_bytes += nb_bytes;
+    watch_writable(server, client, client->length > 0);
+}
+
+static void send_frame(SpectatorServer* server)
+{
+    SpectatorFrame frame;
+
+    if (!read_published(server, &frame))
+        return;
+
+    unsigned char delta[SPECTATOR_MAX_MESSAGE_SIZE];
+    unsigned char keyframe[SPECTATOR_MAX_MESSAGE_SIZE];
+
+    int delta_size = server->has_sent
+        ? spectator_encode_message(&server->last_sent, &frame, delta) : 0;
+    int keyframe_size = 0;
+
+    for (int i = 0; i < SPECTATOR_MAX_CLIENTS; ++i) {
+        SpectatorClient* client = &server->clients[i];
+
+        if (client->fd < 0 || (delta_size == 0 && !client->needs_keyframe))
+            continue;
+
+        if (!spectator_client_needs_keyframe(client, delta_size)) {
+            spectator_client_queue(client, delta, delta_size, false);
+        } else {
+            /* Too far behind, the frames it missed are replaced by this one */
+            if (!client->needs_keyframe)
+                ++server->nb_overflows;
+
+            if (keyframe_size == 0)
+                keyframe_size = spectator_encode_message(NULL, &frame, keyframe);
+
+            spectator_client_queue(client, keyframe, keyframe_size, true);
+        }
+
+        ++server->nb_messages;
+        flush_client(server, client);
+    }
+
+    server->last_sent = frame;
+    server->has_sent = true;
+}
+
+static void accept_clients(SpectatorServer* server)
+{
+    int fd;
+
+    while ((fd = accept(server->listen_fd, NULL, NULL)) >= 0) {
+        SpectatorClient* client = NULL;
+
+        int socket_buffer_size = SPECTATOR_BUFFER_SIZE;
+
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &socket_buffer_size, sizeof(socket_buffer_size));
+
+        for (int i = 0; i < SPECTATOR_MAX_CLIENTS && client == NULL; ++i)
+            if (server->clients[i].fd < 0)
+                client = &server->clients[i];
+
+        unsigned char* buffer = (client != NULL) ? malloc(SPECTATOR_BUFFER_SIZE) : NULL;
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = client };
+
+        if (buffer == NULL || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            free(buffer);
+            close(fd);
+            continue;
+        }
+
+        *client = (SpectatorClient){
+            .fd = fd,
+            .buffer = buffer,
+            .needs_keyframe = true,
+        };
+
+        atomic_fetch_add(&server->nb_clients, 1);
+        ++server->nb_connections;
+    }
+}
+
+/* Spectators have nothing to say, this only notices when they leave */
+static void read_client(SpectatorServer* server, SpectatorClient* client)
+{
+    unsigned char buffer[256];
+    ssize_t size;
+
+    while ((size = recv(client->fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+        ;
+
+    if (size == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        close_client(server, client);
+}
+
+static void* server_thread(void* arg)
+{
+    SpectatorServer* server = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (!atomic_load(&server->stop)) {
+        int nb_events = epoll_wait(server->epoll_fd, events, MAX_EVENTS, -1);
+
+        if (nb_events < 0 && errno == EINTR)
+            continue;
+
+        if (nb_events < 0)
+            break;
+
+        /* New spectators are accepted last, so they don't take the place of
+         * one which left with events still in this batch */
+        bool accept_pending = false;
+
+        for (int i = 0; i < nb_events; ++i) {
+            void* source = events[i].data.ptr;
+
+            if (source == &server->listen_fd) {
+                accept_pending = true;
+            } else if (source == &server->event_fd) {
+                uint64_t nb_signals;
+
+                if (read(server->event_fd, &nb_signals, sizeof(nb_signals)) > 0)
+                    send_frame(server);
+            } else {
+                SpectatorClient* client = source;
+
+                if (client->fd < 0)
+                    continue;
+
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    read_client(server, client);
+
+                if (client->fd >= 0 && (events[i].events & EPOLLOUT))
+                    flush_client(server, client);
+            }
+        }
+
+        if (accept_pending)
+            accept_clients(server);
+    }
+
+    return NULL;
+}
+
+/* A socket left by a server which didn't stop cleanly can be replaced, not
+ * one still in use */
+static void remove_stale_socket(const struct sockaddr_un* address)
+{
+    struct stat st;
+
+    if (lstat(address->sun_path, &st) != 0 || !S_ISSOCK(st.st_mode))
+        return;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd < 0)
+        return;
+
+    if (connect(fd, (const struct sockaddr*)address, sizeof(*address)) != 0
+            && errno == ECONNREFUSED)
+        unlink(address->sun_path);
+
+    close(fd);
+}
+
+static void close_server_fds(SpectatorServer* server)
+{
+    if (server->listen_fd >= 0)
+        close(server->listen_fd);
+
+    if (server->epoll_fd >= 0)
+        close(server->epoll_fd);
+
+    if (server->event_fd >= 0)
+        close(server->event_fd);
+}
+
+static bool add_server_fd(SpectatorServer* server, int* fd)
+{
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = fd };
+
+    return epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, *fd, &event) == 0;
+}
+
+bool spectator_server_start(SpectatorServer* server, const char* path)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+    if (strlen(path) >= sizeof(address.sun_path))
+        return false;
+
+    strcpy(address.sun_path, path);
+
+    server->path = path;
+    atomic_init(&server->stop, false);
+    atomic_init(&server->sequence, 0);
+    atomic_init(&server->nb_clients, 0);
+    server->has_sent = false;
+    server->nb_connections = 0;
+    server->nb_messages = 0;
+    server->nb_bytes = 0;
+    server->nb_overflows = 0;
+
+    for (int i = 0; i < SPECTATOR_MAX_CLIENTS; ++i)
+        server->clients[i] = (SpectatorClient){ .fd = -1 };
+
+    remove_stale_socket(&address);
+
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (server->listen_fd < 0 || server->epoll_fd < 0 || server->event_fd < 0) {
+        close_server_fds(server);
+        return false;
+    }
+
+    if (bind(server->listen_fd, (const struct sockaddr*)&address, sizeof(address)) != 0) {
+        close_server_fds(server);
+        return false;
+    }
+
+    if (listen(server->listen_fd, SOMAXCONN) != 0
+            || !add_server_fd(server, &server->listen_fd)
+            || !add_server_fd(server, &server->event_fd)
+            || pthread_create(&server->thread, NULL, server_thread, server) != 0) {
+        close_server_fds(server);
+        unlink(path);
+        return false;
+    }
+
+    return true;
+}
+
+static void signal_server(SpectatorServer* server)
+{
+    uint64_t one = 1;
+
+    if (write(server->event_fd, &one, sizeof(one)) < 0) {
+        /* Only if the counter is about to overflow, the thread is awake */
+    }
+}
+
+void spectator_server_stop(SpectatorServer* server)
+{
+    atomic_store(&server->stop, true);
+    signal_server(server);
+    pthread_join(server->thread, NULL);
+
+    /* The last frame, usually the end of the game, may not have been sent */
+    send_frame(server);
+
+    for (int i = 0; i < SPECTATOR_MAX_CLIENTS; ++i) {
+        SpectatorClient* client = &server->clients[i];
+
+        if (client->fd >= 0)
+            flush_client(server, client);
+
+        if (client->fd >= 0)
+            close_client(server, client);
+    }
+
+    close_server_fds(server);
+    unlink(server->path);
+}
+
+void spectator_server_publish(SpectatorServer* server, const Game* game, long highscore,
+                              bool paused)
+{
+    unsigned int sequence = atomic_load_explicit(&server->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&server->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    server->published.game = *game;
+    server->published.highscore = highscore;
+    server->published.paused = paused;
+
+    atomic_store_explicit(&server->sequence, sequence + 2, memory_order_release);
+
+    if (atomic_load_explicit(&server->nb_clients, memory_order_relaxed) > 0)
+        signal_server(server);
+}
+
+bool spectator_view_connect(SpectatorView* view, const char* path)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+    if (strlen(path) >= sizeof(address.sun_path))
+        return false;
+
+    strcpy(address.sun_path, path);
+
+    view->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (view->fd < 0)
+        return false;
+
+    if (connect(view->fd, (const struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(view->fd);
+        return false;
+    }
+
+    memset(&view->frame, 0, sizeof(view->frame));
+    view->has_keyframe = false;
+    view->invalid = false;
+    view->length = 0;
+
+    return true;
+}
+
+void spectator_view_close(SpectatorView* view)
+{
+    close(view->fd);
+}
+
+/* Reads fields of a message, failing past its end */
+typedef struct Reader {
+    const unsigned char* p;
+    const unsigned char* end;
+    bool ok;
+} Reader;
+
+static uint64_t get_bytes(Reader* reader, int nb_bytes)
+{
+    if (reader->end - reader->p < nb_bytes) {
+        reader->ok = false;
+        return 0;
+    }
+
+    uint64_t value = 0;
+
+    for (int i = 0; i < nb_bytes; ++i)
+        value |= (uint64_t)reader->p[i] << (8 * i);
+
+    reader->p += nb_bytes;
+
+    return value;
+}
+
+static bool get_tetrimino(Reader* reader, Tetrimino* tetrimino)
+{
+    BlockType type = get_bytes(reader, 1);
+    int angle = get_bytes(reader, 1);
+
+    if (type < BLOCK_TYPE_I || type > BLOCK_TYPE_S || angle > 3)
+        return false;
+
+    tetrimino->type = type;
+    tetrimino->angle = angle;
+    tetrimino->shape_number = get_shape_nb(type, angle);
+
+    return true;
+}
+
+/* Everything the renderer indexes with must be on the board */
+static bool frame_is_valid(const SpectatorFrame* frame)
+{
+    const Game* game = &frame->game;
+
+    if (game->state > GAME_STATE_OVER || game->nb_completed_lines < 0
+            || game->nb_completed_lines > 4)
+        return false;
+
+    for (int i = 0; i < game->nb_completed_lines; ++i)
+        if (game->completed_lines[i] < -BOARD_TOP || game->completed_lines[i] >= WINDOW_HEIGHT)
+            return false;
+
+    if (game->state == GAME_STATE_FALLING) {
+        for (int i = 0; i < 4; ++i) {
+            int x = game->ctetr.x + shapes[game->ctetr.shape_number][i][0];
+            int y = game->ctetr.y + shapes[game->ctetr.shape_number][i][1];
+
+            if (x < 0 || x >= WINDOW_WIDTH || y >= WINDOW_HEIGHT)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static bool decode_message(SpectatorView* view, const unsigned char* message, int size)
+{
+    Reader reader = { .p = message, .end = message + size, .ok = true };
+    SpectatorFrame frame = view->frame;
+    Game* game = &frame.game;
+    int type = get_bytes(&reader, 1);
+
+    if (type == MESSAGE_KEYFRAME) {
+        if (get_bytes(&reader, 1) != WINDOW_WIDTH || get_bytes(&reader, 1) != WINDOW_HEIGHT)
+            return false;
+
+        memset(&frame, 0, sizeof(frame));
+    } else if (type != MESSAGE_DELTA || !view->has_keyframe) {
+        return false;
+    }
+
+    int fields = get_bytes(&reader, 1);
+
+    if (fields & FIELD_PIECE) {
+        game->ctetr.x = (int8_t)get_bytes(&reader, 1);
+        game->ctetr.y = (int16_t)get_bytes(&reader, 2);
+
+        if (!get_tetrimino(&reader, &game->ctetr))
+            return false;
+    }
+
+    if ((fields & FIELD_NEXT) && !get_tetrimino(&reader, &game->ntetr))
+        return false;
+
+    if (fields & FIELD_STATE) {
+        game->state = get_bytes(&reader, 1);
+        frame.paused = get_bytes(&reader, 1);
+        game->nb_completed_lines = get_bytes(&reader, 1);
+
+        for (int i = 0; i < 4; ++i)
+            game->completed_lines[i] = (int16_t)get_bytes(&reader, 2);
+    }
+
+    if (fields & FIELD_SCORE)
+        game->score = get_bytes(&reader, 8);
+
+    if (fields & FIELD_COUNTERS) {
+        game->level = get_bytes(&reader, 4);
+        game->cleared_lines = get_bytes(&reader, 4);
+    }
+
+    if (fields & FIELD_HIGHSCORE)
+        frame.highscore = get_bytes(&reader, 8);
+
+    int nb_rows = (fields & FIELD_ROWS) ? get_bytes(&reader, 1) : 0;
+
+    for (int i = 0; i < nb_rows && reader.ok; ++i) {
+        int y = get_bytes(&reader, 1);
+
+        if (y >= WINDOW_HEIGHT)
+            return false;
+
+        for (int x = 0; x < WINDOW_WIDTH; ++x) {
+            BlockType block = get_bytes(&reader, 1);
+
+            if (block > BLOCK_TYPE_S)
+                return false;
+
+            game->board.colors[BOARD_TOP + y][x] = block;
+        }
+    }
+
+    /* A keyframe must bring everything */
+    if (type == MESSAGE_KEYFRAME && fields != ALL_FIELDS)
+        return false;
+
+    if (!reader.ok || reader.p != reader.end || !frame_is_valid(&frame))
+        return false;
+
+    view->frame = frame;
+    view->has_keyframe = true;
+
+    return true;
+}
+
+/* Apply the complete messages of the buffer, keeping the start of the next */
+static bool decode_buffer(SpectatorView* view)
+{
+    int done = 0;
+
+    while (view->length - done >= 2) {
+        int size = message_size(view->buffer + done);
+
+        if (size > SPECTATOR_MAX_MESSAGE_SIZE || size == 2)
+            return false;
+
+        if (done + size > view->length)
+            break;
+
+        if (!decode_message(view, view->buffer + done + 2, size - 2))
+            return false;
+
+        done += size;
+    }
+
+    memmove(view->buffer, view->buffer + done, view->length - done);
+    view->length -= done;
+
+    return true;
+}
+
+bool spectator_view_update(SpectatorView* view)
+{
+    for (;;) {
+        ssize_t size = recv(view->fd, view->buffer + view->length,
+                            SPECTATOR_BUFFER_SIZE - view->length, MSG_DONTWAIT);
+
+        if (size < 0 && errno == EINTR)
+            continue;
+
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+
+        if (size <= 0)
+            return false;
+
+        view->length += size;
+
+        if (!decode_buffer(view)) {
+            view->invalid = true;
+            return false;
+        }
+    }
+}
+
+bool spectator_view_send(SpectatorView* view, const void* data, int size)
+{
+    while (size > 0) {
+        ssize_t sent = send(view->fd, data, size, MSG_NOSIGNAL);
+
+        if (sent < 0 && errno == EINTR)
+            continue;
+
+        if (sent < 0)
+            return false;
+
+        data = (const char*)data + sent;
+        size -= sent;
+    }
+
+    return true;
+}
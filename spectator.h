@@ -0,0 +1,153 @@
+#ifndef SPECTATOR_H
+#define SPECTATOR_H
+
+/*
+ * Live streaming of a game to spectators over a Unix domain socket (--serve),
+ * and the client side to watch it (--watch).
+ *
+ * The game loop publishes the state of every frame without ever blocking: it
+ * is copied to a single slot guarded by a sequence number, which the server
+ * thread reads back, retrying if the game wrote over it meanwhile. The server
+ * thread waits on epoll for the new frames, connections and sockets ready to
+ * be written to.
+ *
+ * A spectator gets a keyframe with the whole state when it connects, then the
+ * fields which changed at every frame. Each one has a bounded buffer: when a
+ * slow spectator lets it fill up, what it didn't start receiving is dropped
+ * and replaced by a keyframe, so it catches up without ever holding back the
+ * game or the other spectators.
+ *
+ * Messages are a 16-bit length, a type and the fields, little endian.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "core.h"
+
+#define SPECTATOR_MAX_CLIENTS 64
+
+/*
+ * Bytes queued per spectator, a few keyframes. The sockets only buffer about
+ * as much, so a spectator is never more than a second or so behind the game.
+ */
+#define SPECTATOR_BUFFER_SIZE (4 * (64 + WINDOW_HEIGHT * (1 + WINDOW_WIDTH)))
+
+/* Length, type, board size, fields, then every field with all the rows. The
+ * piece height and lines are 16-bit, as boards can have over 127 rows */
+#define SPECTATOR_MAX_MESSAGE_SIZE (2 + 1 + 2 + 1 + 5 + 2 + 11 + 8 + 8 + 8 + 1 \
+                                    + WINDOW_HEIGHT * (1 + WINDOW_WIDTH))
+
+/* What a spectator sees of a frame */
+typedef struct SpectatorFrame {
+    /* Only the board colors, the tetriminos, the state and the counters of
+     * the game are sent */
+    Game game;
+    long highscore;
+    bool paused;
+} SpectatorFrame;
+
+typedef struct SpectatorClient {
+    int fd;
+    unsigned char* buffer;
+
+    /* Bytes queued, and bytes already sent of the first message */
+    int length;
+    int sent;
+
+    /* Just connected, the next frame is sent whole */
+    bool needs_keyframe;
+
+    /* Waiting for the socket to be writable */
+    bool writing;
+} SpectatorClient;
+
+/*
+ * Write the message bringing a spectator from old to frame, or a keyframe if
+ * old is NULL. Returns its size, 0 if nothing changed.
+ */
+int spectator_encode_message(const SpectatorFrame* old, const SpectatorFrame* frame,
+                             unsigned char message[SPECTATOR_MAX_MESSAGE_SIZE]);
+
+/* Whether the client must get a keyframe instead of a message of this size,
+ * because it just connected or is too far behind */
+bool spectator_client_needs_keyframe(const SpectatorClient* client, int size);
+
+/* A keyframe replaces everything the client didn't start receiving */
+void spectator_client_queue(SpectatorClient* client, const unsigned char* message, int size,
+                            bool keyframe);
+
+/* Send what the socket takes without blocking, dropping the messages sent.
+ * Returns the number of bytes sent, -1 if the connection is lost */
+long spectator_client_send(SpectatorClient* client);
+
+typedef struct SpectatorServer {
+    pthread_t thread;
+    const char* path;
+    int listen_fd;
+    int epoll_fd;
+
+    /* Signaled by the game for every frame, and to stop */
+    int event_fd;
+    atomic_bool stop;
+
+    /* Latest frame of the game, odd sequence numbers while it is written */
+    SpectatorFrame published;
+    _Atomic unsigned int sequence;
+
+    /* Spectators connected, so the game doesn't signal frames to nobody */
+    atomic_int nb_clients;
+
+    /* Only used by the server thread */
+    SpectatorClient clients[SPECTATOR_MAX_CLIENTS];
+    SpectatorFrame last_sent;
+    bool has_sent;
+
+    /* Statistics, to be read once the server is stopped */
+    long nb_connections;
+    long nb_messages;
+    long nb_bytes;
+    long nb_overflows;
+} SpectatorServer;
+
+/* Listen on a socket at path, replacing a stale one. Returns false if it
+ * could not be set up */
+bool spectator_server_start(SpectatorServer* server, const char* path);
+
+/* Disconnect the spectators and remove the socket */
+void spectator_server_stop(SpectatorServer* server);
+
+/* Send the state of the game to the spectators, only called by the game loop */
+void spectator_server_publish(SpectatorServer* server, const Game* game, long highscore,
+                              bool paused);
+
+typedef struct SpectatorView {
+    int fd;
+
+    /* The game as last received, valid once has_keyframe */
+    SpectatorFrame frame;
+    bool has_keyframe;
+
+    /* The server sent something which isn't a valid stream for this build */
+    bool invalid;
+
+    /* Received bytes not parsed yet */
+    unsigned char buffer[SPECTATOR_BUFFER_SIZE];
+    int length;
+} SpectatorView;
+
+/* Connect to the server at path. Returns false if it can't be reached */
+bool spectator_view_connect(SpectatorView* view, const char* path);
+void spectator_view_close(SpectatorView* view);
+
+/* Apply everything the server sent since the last call, without blocking.
+ * Returns false once the stream is over */
+bool spectator_view_update(SpectatorView* view);
+
+/* Send bytes to the server, for the players of tetris-server. Returns false
+ * if the connection is lost */
+bool spectator_view_send(SpectatorView* view, const void* data, int size);
+
+#endif
@@ -0,0 +1,514 @@
+/*
+ * Checks run with `make test`, exiting with 1 if any fails.
+ *
+ * The collision tests compare the shape masks with cell by cell versions of
+ * shape_can_fit and can_move_*, looking at the blocks of a shape one at a time
+ * like the game did before the masks. Every shape is tried at every position
+ * on random boards, from empty to almost full, including the vanishing zone.
+ *
+ * The path tests search every way to place a piece by stepping copies of the
+ * game through game_step, one button per frame, and compare the places where
+ * it locks and their cost with path_search. The inputs of every path are then
+ * played to check that the piece locks where expected.
+ *
+ * The evaluation tests compare the features of random batches from every
+ * kernel the CPU supports with eval_board_features, board by board. Boards
+ * go from empty to full, blocks above the board included, so the counts of
+ * the vector kernels reach their largest values before being folded.
+ *
+ * The line tests lock pieces on random boards with almost complete rows,
+ * also above the board, and compare the lines found by check_for_complete_lines
+ * with a scan of every row, then removing them all at once with removing them
+ * one by one with remove_line.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "eval.h"
+#include "path.h"
+
+#define NB_BOARDS 2000
+#define NB_PATH_GAMES 300
+#define NB_EVAL_BATCHES 5000
+#define NB_LOCKS 100000
+
+int nb_failures = 0;
+
+static void fail(const char* format, ...)
+{
+    va_list args;
+
+    if (nb_failures++ >= 10)
+        return;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+/* A cell is free if it is in the board, or above it, and not occupied */
+static bool cell_is_free(const Board* board, int x, int y)
+{
+    return x >= 0 && x < WINDOW_WIDTH && y >= -BOARD_TOP && y < WINDOW_HEIGHT
+        && !board_is_occupied(board, x, y);
+}
+
+static bool reference_shape_can_fit(const Game* game, int tx, int ty, int shape_number)
+{
+    for (int i = 0; i < 4; ++i) {
+        int x = tx + shapes[shape_number][i][0];
+        int y = ty + shapes[shape_number][i][1];
+
+        if (!cell_is_free(&game->board, x, y))
+            return false;
+    }
+
+    return true;
+}
+
+static bool reference_can_move(const Game* game, int dx, int dy)
+{
+    const Tetrimino* ctetr = &game->ctetr;
+
+    for (int i = 0; i < 4; ++i) {
+        int x = ctetr->x + shapes[ctetr->shape_number][i][0];
+        int y = ctetr->y + shapes[ctetr->shape_number][i][1];
+
+        if (!cell_is_free(&game->board, x + dx, y + dy))
+            return false;
+    }
+
+    return true;
+}
+
+static void check(bool value, bool expected, const char* name, int x, int y, int shape_number)
+{
+    if (value != expected)
+        fail("%s: shape %d at (%d, %d) gives %d instead of %d\n", name, shape_number, x, y,
+             value, expected);
+}
+
+/* Blocks set with a probability of density / 16, in the field and above it */
+static void random_board(Board* board, unsigned int* seed, int density)
+{
+    board_init(board);
+
+    for (int y = -BOARD_TOP; y < WINDOW_HEIGHT; ++y)
+        for (int x = 0; x < WINDOW_WIDTH; ++x)
+            if (rand_r(seed) % 16 < density)
+                board_set(board, x, y, BLOCK_TYPE_I);
+}
+
+static void test_collisions()
+{
+    unsigned int seed = 1;
+    Game game;
+
+    game_init(&game, 0, 1);
+
+    for (int b = 0; b < NB_BOARDS; ++b) {
+        random_board(&game.board, &seed, b % 16);
+
+        /* Every position where a shape is in the walls at most, rows_can_fit
+         * only supports these */
+        for (int shape_number = 0; shape_number < 28; ++shape_number) {
+            for (int y = 0; y <= WINDOW_HEIGHT; ++y) {
+                for (int x = -1; x <= WINDOW_WIDTH; ++x) {
+                    bool fits = reference_shape_can_fit(&game, x, y, shape_number);
+
+                    check(shape_can_fit(&game, x, y, shape_number), fits, "shape_can_fit", x,
+                          y, shape_number);
+
+                    /* The game only moves pieces which fit */
+                    if (!fits)
+                        continue;
+
+                    game.ctetr.x = x;
+                    game.ctetr.y = y;
+                    game.ctetr.shape_number = shape_number;
+
+                    check(can_move_down(&game), reference_can_move(&game, 0, 1),
+                          "can_move_down", x, y, shape_number);
+                    check(can_move_left(&game), reference_can_move(&game, -1, 0),
+                          "can_move_left", x, y, shape_number);
+                    check(can_move_right(&game), reference_can_move(&game, 1, 0),
+                          "can_move_right", x, y, shape_number);
+                }
+            }
+        }
+    }
+}
+
+/* A piece of the path tests, numbered like the states of path.c */
+static int path_state(const Game* game)
+{
+    const Tetrimino* ctetr = &game->ctetr;
+    int phase = game->nb_frames % game->fall_rate;
+
+    return ((phase * 4 + ctetr->angle) * PATH_ROWS + ctetr->y) * PATH_COLUMNS + ctetr->x + 1;
+}
+
+static const Input path_buttons[6] = {
+    INPUT_NONE, INPUT_LEFT, INPUT_RIGHT, INPUT_DOWN, INPUT_ROTATE_CW, INPUT_ROTATE_CCW,
+};
+
+static PathSearch path_search_state;
+
+/* Fewest frames, then fewest presses, to each state and to each place where
+ * the piece locks, -1 when not reached */
+static int state_frames[PATH_NB_STATES];
+static int state_presses[PATH_NB_STATES];
+static long end_costs[PATH_NB_POSITIONS];
+
+static Tetrimino state_pieces[PATH_NB_STATES];
+static int state_phases[PATH_NB_STATES];
+
+/*
+ * Search the frames one at a time from the state of the game, keeping the
+ * fewest presses to each state reached in the frame. A piece which can't fall
+ * at a gravity frame locks there.
+ */
+static void reference_paths(const Game* game)
+{
+    static int layer[PATH_NB_STATES];
+    static int next_layer[PATH_NB_STATES];
+    int nb_layer = 1;
+
+    memset(state_frames, -1, sizeof(state_frames));
+    memset(end_costs, -1, sizeof(end_costs));
+
+    layer[0] = path_state(game);
+    state_frames[layer[0]] = 0;
+    state_presses[layer[0]] = 0;
+    state_pieces[layer[0]] = game->ctetr;
+    state_phases[layer[0]] = game->nb_frames % game->fall_rate;
+
+    for (int frame = 0; nb_layer > 0; ++frame) {
+        int nb_next = 0;
+
+        for (int i = 0; i < nb_layer; ++i) {
+            int state = layer[i];
+            Game from = *game;
+
+            from.ctetr = state_pieces[state];
+            from.nb_frames = state_phases[state];
+
+            if (from.nb_frames == 0 && !can_move_down(&from)) {
+                int position = state % PATH_NB_POSITIONS;
+                long cost = (long)frame << 16 | state_presses[state];
+
+                if (end_costs[position] < 0 || cost < end_costs[position])
+                    end_costs[position] = cost;
+
+                continue;
+            }
+
+            for (int b = 0; b < 6; ++b) {
+                Game to = from;
+
+                game_step(&to, path_buttons[b]);
+
+                int next = path_state(&to);
+                int presses = state_presses[state] + (b != 0);
+
+                if (state_frames[next] < 0) {
+                    state_frames[next] = frame + 1;
+                    state_presses[next] = presses;
+                    state_pieces[next] = to.ctetr;
+                    state_phases[next] = to.nb_frames % to.fall_rate;
+                    next_layer[nb_next++] = next;
+                } else if (state_frames[next] == frame + 1 && presses < state_presses[next]) {
+                    state_presses[next] = presses;
+                }
+            }
+        }
+
+        memcpy(layer, next_layer, nb_next * sizeof(int));
+        nb_layer = nb_next;
+    }
+}
+
+/* The end of the search at the position, or at one with the same cells */
+static const PathEnd* find_end(const PathSearch* search, int x, int y, int shape_number)
+{
+    for (int i = 0; i < search->nb_ends; ++i) {
+        const Placement* p = &search->ends[i].placement;
+
+        if (p->x == x && p->y == y && shape_masks[p->shape_number] == shape_masks[shape_number])
+            return &search->ends[i];
+    }
+
+    return NULL;
+}
+
+static void check_paths(const Game* game)
+{
+    static Input inputs[PATH_MAX_FRAMES];
+    PathSearch* search = &path_search_state;
+    int nb_ends = path_search(search, game);
+    int nb_expected = 0;
+
+    reference_paths(game);
+
+    for (int angle = 0; angle < 4; ++angle) {
+        int shape_number = get_shape_nb(game->ctetr.type, angle);
+
+        for (int y = 0; y < PATH_ROWS; ++y) {
+            for (int column = 0; column < PATH_COLUMNS; ++column) {
+                long cost = end_costs[(angle * PATH_ROWS + y) * PATH_COLUMNS + column];
+                bool first = true;
+
+                if (cost < 0)
+                    continue;
+
+                /* Angles with the same cells are one end, the cheapest */
+                for (int other = 0; other < 4; ++other) {
+                    long other_cost = end_costs[(other * PATH_ROWS + y) * PATH_COLUMNS + column];
+                    int other_shape = get_shape_nb(game->ctetr.type, other);
+
+                    if (other_cost < 0 || shape_masks[other_shape] != shape_masks[shape_number])
+                        continue;
+
+                    if (other < angle)
+                        first = false;
+
+                    if (other_cost < cost)
+                        cost = other_cost;
+                }
+
+                if (!first)
+                    continue;
+
+                ++nb_expected;
+
+                const PathEnd* end = find_end(search, column - 1, y, shape_number);
+
+                if (end == NULL)
+                    fail("path_search: shape %d at (%d, %d) not found\n", shape_number,
+                         column - 1, y);
+                else if (end->nb_frames != cost >> 16 || end->nb_presses != (cost & 0xFFFF))
+                    fail("path_search: shape %d at (%d, %d) in %d frames and %d presses "
+                         "instead of %ld and %ld\n", shape_number, column - 1, y,
+                         end->nb_frames, end->nb_presses, cost >> 16, cost & 0xFFFF);
+            }
+        }
+    }
+
+    if (nb_ends != nb_expected)
+        fail("path_search: %d ends instead of %d\n", nb_ends, nb_expected);
+
+    for (int i = 0; i < nb_ends; ++i) {
+        const PathEnd* end = &search->ends[i];
+        int nb_frames = path_inputs(search, end, inputs);
+        Game played = *game;
+        bool locked = false;
+
+        for (int frame = 0; frame < nb_frames && !locked; ++frame)
+            locked = game_step(&played, inputs[frame]);
+
+        if (locked || !game_step(&played, INPUT_NONE) || played.ctetr.x != end->placement.x
+                || played.ctetr.y != end->placement.y
+                || shape_masks[played.ctetr.shape_number]
+                       != shape_masks[end->placement.shape_number])
+            fail("path_inputs: shape %d doesn't lock at (%d, %d)\n",
+                 end->placement.shape_number, end->placement.x, end->placement.y);
+    }
+}
+
+/* Pieces on random stacks with overhangs, at every speed, a few frames after
+ * they spawn */
+static void test_paths()
+{
+    static const int levels[] = {0, 5, 9, 13, 18, 19, 29};
+    unsigned int seed = 1;
+
+    for (int g = 0; g < NB_PATH_GAMES; ++g) {
+        Game game;
+
+        game_init(&game, levels[g % 7], 1 + rand_r(&seed) % 1000);
+
+        int height = rand_r(&seed) % (WINDOW_HEIGHT / 2);
+
+        for (int y = WINDOW_HEIGHT - height; y < WINDOW_HEIGHT; ++y)
+            for (int x = 0; x < WINDOW_WIDTH; ++x)
+                if (rand_r(&seed) % 3 == 0)
+                    board_set(&game.board, x, y, BLOCK_TYPE_I);
+
+        for (int frame = rand_r(&seed) % 5; frame > 0; --frame)
+            game_step(&game, path_buttons[rand_r(&seed) % 6]);
+
+        if (game.state == GAME_STATE_FALLING)
+            check_paths(&game);
+    }
+}
+
+/* Rows filled from a random height, some of them full or above the board */
+static void random_rows(BoardRow rows[BOARD_ROWS], unsigned int* seed)
+{
+    int top = rand_r(seed) % (EVAL_ROWS + 1);
+    int density = rand_r(seed) % 17;
+
+    for (int y = 0; y < BOARD_ROWS; ++y)
+        rows[y] = (y < EVAL_ROWS) ? EMPTY_ROW : FULL_ROW;
+
+    for (int y = EVAL_ROWS - top; y < EVAL_ROWS; ++y)
+        for (int x = 0; x < WINDOW_WIDTH; ++x)
+            if (rand_r(seed) % 16 < density)
+                rows[y] |= (BoardRow)1 << (WALL_WIDTH + x);
+}
+
+static void test_eval_kernels()
+{
+    unsigned int seed = 1;
+    EvalBatch batch;
+    EvalFeatures features;
+
+    for (int b = 0; b < NB_EVAL_BATCHES; ++b) {
+        BoardFeatures expected[EVAL_BATCH_SIZE];
+        BoardRow rows[BOARD_ROWS];
+
+        eval_batch_clear(&batch);
+
+        for (int i = 1 + rand_r(&seed) % EVAL_BATCH_SIZE; i > 0; --i) {
+            random_rows(rows, &seed);
+            eval_board_features(rows, &expected[eval_batch_add(&batch, rows)]);
+        }
+
+        for (EvalKernel kernel = 0; kernel < EVAL_NB_KERNELS; ++kernel) {
+            if (!eval_kernel_is_supported(kernel))
+                continue;
+
+            eval_batch_features(&batch, &features, kernel);
+
+            for (int i = 0; i < batch.nb_boards; ++i) {
+                const BoardFeatures* f = &expected[i];
+
+                if (features.height[i] != f->height || features.holes[i] != f->holes
+                        || features.bumpiness[i] != f->bumpiness
+                        || features.row_transitions[i] != f->row_transitions
+                        || features.wells[i] != f->wells || !features.lost[i] != !f->lost)
+                    fail("%s kernel: board %d of batch %d differs\n", eval_kernel_names[kernel],
+                         i, b);
+            }
+        }
+    }
+}
+
+/* Rows with one cell missing or a few, none complete */
+static void random_incomplete_board(Board* board, unsigned int* seed)
+{
+    board_init(board);
+
+    for (int y = -BOARD_TOP; y < WINDOW_HEIGHT; ++y) {
+        int missing = rand_r(seed) % WINDOW_WIDTH;
+        bool almost_full = rand_r(seed) % 2;
+
+        for (int x = 0; x < WINDOW_WIDTH; ++x)
+            if (x != missing && (almost_full || rand_r(seed) % 2))
+                board_set(board, x, y, 1 + rand_r(seed) % 7);
+    }
+}
+
+/*
+ * Lock a random piece on a random board, where the rows of the piece are only
+ * missing its cells once in two. Returns false if the piece is out of the
+ * board.
+ */
+static bool lock_random_piece(Game* game, unsigned int* seed)
+{
+    Tetrimino* ctetr = &game->ctetr;
+
+    *ctetr = make_new_tetrimino(1 + rand_r(seed) % 7);
+    ctetr->angle = rand_r(seed) % 4;
+    ctetr->shape_number = get_shape_nb(ctetr->type, ctetr->angle);
+    ctetr->x = rand_r(seed) % WINDOW_WIDTH;
+    ctetr->y = rand_r(seed) % WINDOW_HEIGHT;
+
+    random_incomplete_board(&game->board, seed);
+
+    for (int i = 0; i < 4; ++i) {
+        int x = ctetr->x + shapes[ctetr->shape_number][i][0];
+        int y = ctetr->y + shapes[ctetr->shape_number][i][1];
+
+        if (x < 0 || x >= WINDOW_WIDTH || y >= WINDOW_HEIGHT)
+            return false;
+
+        if (rand_r(seed) % 2)
+            for (int other = 0; other < WINDOW_WIDTH; ++other)
+                board_set(&game->board, other, y, BLOCK_TYPE_I);
+    }
+
+    /* Make room for the piece */
+    for (int i = 0; i < 4; ++i) {
+        int x = ctetr->x + shapes[ctetr->shape_number][i][0];
+        int y = ctetr->y + shapes[ctetr->shape_number][i][1];
+
+        game->board.rows[BOARD_TOP + y] &= ~((BoardRow)1 << (WALL_WIDTH + x));
+        game->board.colors[BOARD_TOP + y][x] = BLOCK_TYPE_NONE;
+    }
+
+    add_blocks_to_board(game);
+
+    return true;
+}
+
+static void test_lines()
+{
+    unsigned int seed = 1;
+    Game game;
+
+    game_init(&game, 0, 1);
+
+    for (int i = 0; i < NB_LOCKS; ++i) {
+        if (!lock_random_piece(&game, &seed))
+            continue;
+
+        int lines[BOARD_TOP + WINDOW_HEIGHT];
+        int nb_lines = 0;
+
+        for (int y = -BOARD_TOP; y < WINDOW_HEIGHT; ++y)
+            if (line_is_complete(&game, y))
+                lines[nb_lines++] = y;
+
+        if (check_for_complete_lines(&game) != nb_lines
+                || memcmp(game.completed_lines, lines, nb_lines * sizeof(int)) != 0) {
+            fail("check_for_complete_lines: %d lines instead of %d for shape %d at (%d, %d)\n",
+                 game.nb_completed_lines, nb_lines, game.ctetr.shape_number, game.ctetr.x,
+                 game.ctetr.y);
+            continue;
+        }
+
+        /* From the top, removing a line doesn't move the ones below */
+        Game one_by_one = game;
+
+        for (int l = 0; l < nb_lines; ++l)
+            remove_line(&one_by_one, lines[l]);
+
+        remove_lines(&game, lines, nb_lines);
+
+        if (memcmp(&game.board, &one_by_one.board, sizeof(Board)) != 0)
+            fail("remove_lines: %d lines from %d give another board than remove_line\n",
+                 nb_lines, lines[0]);
+    }
+}
+
+int main()
+{
+    test_collisions();
+    test_paths();
+    test_eval_kernels();
+    test_lines();
+
+    if (nb_failures > 0) {
+        fprintf(stderr, "%d checks failed\n", nb_failures);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+
+    return 0;
+}
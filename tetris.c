@@ -7,162 +7,96 @@
 #include <time.h>
 #include <stdlib.h>
 #include <string.h>
+#include <termios.h>
+
+#include "ai.h"
+#include "ansi.h"
+#include "core.h"
+#include "frame_clock.h"
+#include "frame_stats.h"
+#include "highscores.h"
+#include "keyboard.h"
+#include "path.h"
+#include "render.h"
+#include "replay.h"
+#include "search.h"
+#include "spectator.h"
+
+/* Run at around 60 fps, in nanoseconds */
+const long refresh_delay = 16640000;
+
+/* Path to the file were the highscores are stored,
+ * $HOME/.config/ncurses_tetris/highscores */
+char* high_score_file;
 
-#define WINDOW_WIDTH 10
-#define WINDOW_HEIGHT 20
-
-typedef enum BlockType {
-    BLOCK_TYPE_NONE = 0,
-    BLOCK_TYPE_I    = 1,
-    BLOCK_TYPE_O    = 2,
-    BLOCK_TYPE_T    = 3,
-    BLOCK_TYPE_L    = 4,
-    BLOCK_TYPE_J    = 5,
-    BLOCK_TYPE_Z    = 6,
-    BLOCK_TYPE_S    = 7,
-} BlockType;
-
-/* Possible shapes of all tetriminos given a rotation angle */
-char shapes[28][4][2] = {
-    /* angle 0 -- facing down */
-    {{-2,  0}, {-1,  0}, { 0,  0}, { 1,  0}},  //  0 : I
-    {{-1,  0}, { 0,  0}, {-1,  1}, { 0,  1}},  //  1 : O
-    {{-1,  0}, { 0,  0}, { 1,  0}, { 0,  1}},  //  2 : T
-    {{-1,  0}, { 0,  0}, { 1,  0}, {-1,  1}},  //  3 : L
-    {{-1,  0}, { 0,  0}, { 1,  0}, { 1,  1}},  //  4 : J
-    {{-1,  0}, { 0,  0}, { 0,  1}, { 1,  1}},  //  5 : Z
-    {{ 0,  0}, { 1,  0}, {-1,  1}, { 0,  1}},  //  6 : S
-
-    /* angle 1 -- facing left */
-    {{ 0, -2}, { 0, -1}, { 0,  0}, { 0,  1}},  //  7 : I
-    {{-1,  0}, { 0,  0}, {-1,  1}, { 0,  1}},  //  8 : O
-    {{ 0, -1}, {-1,  0}, { 0,  0}, { 0,  1}},  //  9 : T
-    {{-1, -1}, { 0, -1}, { 0,  0}, { 0,  1}},  // 10 : L
-    {{ 0, -1}, { 0,  0}, {-1,  1}, { 0,  1}},  // 11 : J
-    {{ 1, -1}, { 0,  0}, { 1,  0}, { 0,  1}},  // 12 : Z
-    {{ 0, -1}, { 0,  0}, { 1,  0}, { 1,  1}},  // 13 : S
-
-    /* angle 2 -- facing up */
-    {{-2,  0}, {-1,  0}, { 0,  0}, { 1,  0}},  // 14 : I
-    {{-1,  0}, { 0,  0}, {-1,  1}, { 0,  1}},  // 15 : O
-    {{-1,  0}, { 0,  0}, { 1,  0}, { 0, -1}},  // 16 : T
-    {{ 1, -1}, {-1,  0}, { 0,  0}, { 1,  0}},  // 17 : L
-    {{-1, -1}, {-1,  0}, { 0,  0}, { 1,  0}},  // 18 : J
-    {{-1,  0}, { 0,  0}, { 0,  1}, { 1,  1}},  // 19 : Z
-    {{ 0,  0}, { 1,  0}, {-1,  1}, { 0,  1}},  // 20 : S
-
-    /* angle 3 -- facing right */
-    {{ 0, -2}, { 0, -1}, { 0,  0}, { 0,  1}},  // 21 : I
-    {{-1,  0}, { 0,  0}, {-1,  1}, { 0,  1}},  // 22 : O
-    {{ 0, -1}, { 0,  0}, { 1,  0}, { 0,  1}},  // 23 : T
-    {{ 0, -1}, { 0,  0}, { 0,  1}, { 1,  1}},  // 24 : L
-    {{ 0, -1}, { 1, -1}, { 0,  0}, { 0,  1}},  // 25 : J
-    {{ 1, -1}, { 0,  0}, { 1,  0}, { 0,  1}},  // 26 : Z
-    {{ 0, -1}, { 0,  0}, { 1,  0}, { 1,  1}},  // 27 : S
-};
-
-/* Values used to center the tetrimino in the preview box */
-char center_lengths[7] = {
-    5, // I
-    5, // O
-    4, // T
-    4, // L
-    4, // J
-    4, // Z
-    4, // S
-};
-
-/* Run at around 60 fps */
-const int refresh_delay = 16640;
-
-/* The number of frame every step of the curtain animation will last */
-const int curtain_frame_freq = 10;
-
-/* Path to the file were the highscore is stored,
+/* Older versions only kept the best score, in
  * $HOME/.config/ncurses_tetris/highscore */
-char* high_score_file;
+char* old_high_score_file;
 
+/* The table as read at startup, then as updated at the end of the game */
+Highscores highscores;
 long old_highscore = 0;
 long highscore = 0;
-long score = 0;
 
-int level = 0;
-int start_level = 0;
-int lines_before_next_level;
-int cleared_lines = 0;
-
-/* Tetrimino's position will be updated once every fall_rate frame */
-int fall_rate = 48;
+/* Rank of the game in the highscores, -1 if it didn't enter them */
+int highscore_rank = -1;
 
 bool end_game = false;
 bool game_is_paused = false;
 
-// @Hack : This starts at one so the game doesn't update right away
-int nb_frames = 1;
+/* Print the frame timing statistics when the game is over */
+bool print_stats = false;
 
-WINDOW* level_box;
-WINDOW* score_box;
-WINDOW* highscore_box;
-WINDOW* lines_box;
-WINDOW* game_box;
-WINDOW* pause_box;
-WINDOW* next_piece_box;
+/* Only print the highscores (--highscores) */
+bool show_highscores = false;
 
-BlockType blocks[WINDOW_WIDTH][WINDOW_HEIGHT];
+/* Used by the game over animation */
+int nb_frames = 0;
 
-typedef struct Tetrimino {
-    /* Position of the tetrimino */
-    int x;
-    int y;
+Game game;
 
-    /* Rotation angle, from 0 to 3 */
-    int angle;
+FrameClock frame_clock;
 
-    /* Type can be either I, O, T, L, J, Z or S */
-    BlockType type;
+Keyboard keyboard;
+Controller controller;
 
-    /* Combination of type and angle, id of the shape in the shapes array */
-    int shape_number;
-} Tetrimino;
+/* Time taken by every phase of the last frames, shown with t and written to a
+ * file on exit with --timings */
+FrameStats frame_stats;
+bool show_frame_stats = false;
+const char* timings_path = NULL;
 
-/* The tetrimino currently controlled by the player */
-Tetrimino ctetr;
+/* Frames between two refreshes of the timings panel */
+const int frame_stats_refresh_freq = 15;
 
-/* The tetrimino available next */
-Tetrimino ntetr;
+/* Show where the bot would put the current piece, among every place it can
+ * reach, and the inputs to get there (f). Searched once per piece */
+bool show_hint = false;
+long hint_piece = -1;
+PathSearch hint_search;
 
-// @Optim : precompute this
-int get_shape_nb(BlockType type, int angle)
-{
-    return (type - 1) + 7 * angle;
-}
+/* Replay being recorded (--record) or played back (--replay) */
+Replay replay;
+const char* record_path = NULL;
+const char* replay_path = NULL;
+bool replay_is_over = false;
 
-/* Each "pixel" is two characters wide */
-void print_pixel(int x, int y, WINDOW* window)
-{
-    if (y >= 0) {
-        mvwaddch(window, 1+y, 1+2*x, ACS_BLOCK);
-        mvwaddch(window, 1+y, 2+2*x, ACS_BLOCK);
-    }
-}
+/* Play the replay as fast as possible, without a terminal */
+bool headless = false;
 
-void print_shiny_pixel(int x, int y, WINDOW* window)
-{
-    if (y >= 0) {
-        mvwaddch(window, 1+y, 1+2*x, ACS_CKBOARD);
-        mvwaddch(window, 1+y, 2+2*x, ACS_CKBOARD);
-    }
-}
+/* Let the AI play (--ai), searching deeper with --depth */
+bool use_ai = false;
+AiPlayer ai;
+SearchLimits search_limits;
+int search_depth = 0;
 
-int max(int a, int b)
-{
-    return (a > b) ? a : b;
-}
-
-int min(int a, int b)
-{
-    return (a < b) ? a : b;
-}
+/* Stream the game to spectators (--serve), watch one (--watch), or play on a
+ * tetris-server (--connect) */
+SpectatorServer spectators;
+const char* serve_path = NULL;
+const char* watch_path = NULL;
+const char* connect_path = NULL;
+SpectatorView view;
 
 /* Initialise the value of high_score_file.
  * This is needed as $HOME must be expanded */
@@ -174,6 +108,7 @@ void init_highscore_info()
     int len_home_path = strlen(home_dir);
     high_score_dir = calloc(len_home_path + 100, sizeof(char));
     high_score_file = calloc(len_home_path + 100, sizeof(char));
+    old_high_score_file = calloc(len_home_path + 100, sizeof(char));
 
     strcat(high_score_dir, home_dir);
     strcat(high_score_dir, "/.config/ncurses_tetris");
@@ -182,7 +117,10 @@ void init_highscore_info()
     mkdir(high_score_dir, 0777);
 
     strcat(high_score_file, high_score_dir);
-    strcat(high_score_file, "/highscore");
+    strcat(high_score_file, "/highscores");
+
+    strcat(old_high_score_file, high_score_dir);
+    strcat(old_high_score_file, "/highscore");
 
     free(high_score_dir);
 }
@@ -190,651 +128,620 @@ void init_highscore_info()
 void deinit_highscore_info()
 {
     free(high_score_file);
+    free(old_high_score_file);
 }
 
-void read_highscore()
+/* Returns false if the highscores could not be read, which isn't printed here
+ * as the terminal may belong to curses already */
+bool read_highscore()
 {
-    FILE* file = fopen(high_score_file, "r");
+    /* Also moves the best score of older versions to the table, once */
+    bool ok = highscores_import(high_score_file, old_high_score_file, &highscores);
 
-    if (file != NULL) {
-        if (fscanf(file, "%ld\n", &highscore) != 1)
-            assert(0 && "Reading highscore from file failed");
+    highscore = highscores_best(&highscores);
+    old_highscore = highscore;
 
-        old_highscore = highscore;
-        fclose(file);
-    }
+    return ok;
 }
 
 void update_highscore()
 {
-    if (highscore > old_highscore) {
-        FILE* file = fopen(high_score_file, "w");
-
-        if (file != NULL) {
-            fprintf(file, "%ld\n", highscore);
-            fclose(file);
-        } else {
-            assert(0 && "Highscore file could not be opened");
-        }
+    HighscoreEntry entry = {
+        .score = game.score,
+        .lines = game.cleared_lines,
+        .level = game.level,
+        .start_level = game.start_level,
+        .date = time(NULL),
+        .seed = game.seed,
+    };
+
+    if (!highscores_add(high_score_file, &entry, &highscores, &highscore_rank))
+        fprintf(stderr, "Could not save the score to %s\n", high_score_file);
+}
+
+/* Print the table, best first */
+void print_highscores()
+{
+    for (int i = 0; i < highscores.nb_entries; ++i) {
+        const HighscoreEntry* entry = &highscores.entries[i];
+        time_t date = entry->date;
+        char date_string[32] = "unknown date";
+
+        /* Scores of older versions come without the details of the game */
+        if (date != 0)
+            strftime(date_string, sizeof(date_string), "%Y-%m-%d %H:%M", localtime(&date));
+        printf("%2d. %10ld  %4d lines  level %2d (from %2d)  %s  seed %u\n", i + 1,
+               entry->score, entry->lines, entry->level, entry->start_level, date_string,
+               entry->seed);
     }
 }
 
-Tetrimino make_new_tetrimino(BlockType type)
+long long now_ns()
 {
-    Tetrimino t;
-
-    t.type = type;
-    t.angle = 0;
-
-    t.x = 5;
-    t.y = 0;
-
-    t.shape_number = get_shape_nb(t.type, t.angle);
-
-    return t;
-}
-
-/* Use the same random generator as NES Tetris */
-void get_new_tetrimino()
-{
-    BlockType old_type = ntetr.type;
-    BlockType new_type = rand() % 8;
-
-    if (new_type == old_type || new_type == 0)
-        new_type = 1 + rand() % 7;
-
-    ctetr = ntetr;
-    ntetr = make_new_tetrimino(new_type);
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
 }
 
-bool shape_can_fit(int tx, int ty, int shape_number)
+void handle_command(int key)
 {
-    for (int i = 0; i < 4; ++i) {
-        int x = tx + shapes[shape_number][i][0];
-        int y = ty + shapes[shape_number][i][1];
-
-        if (y < 0)
-            continue;
-        else if (x < 0 || x >= WINDOW_WIDTH || y >= WINDOW_HEIGHT || blocks[x][y])
-            return false;
-    }
+    switch (key) {
+        case 'p':
+            game_is_paused = true;
+            break;
 
-    return true;
-}
+        case 't':
+            show_frame_stats = !show_frame_stats;
 
-void rotate_tetrimino(int angle)
-{
-    // C modulos really are great
-    if (angle == -1)
-        angle = 3;
+            if (!show_frame_stats)
+                hide_frame_stats();
+            break;
 
-    assert(angle >= 0);
+        case 'f':
+            show_hint = !show_hint;
+            hint_piece = -1;
 
-    int new_angle = (ctetr.angle + angle) % 4;
-    int new_shape_nb = get_shape_nb(ctetr.type, new_angle);
+            if (!show_hint)
+                hide_hint();
+            break;
 
-    if (shape_can_fit(ctetr.x, ctetr.y, new_shape_nb)) {
-        ctetr.angle = new_angle;
-        ctetr.shape_number = new_shape_nb;
+        case 'q':
+            end_game = true;
     }
 }
 
-/* Returns the height of the locked piece (used for the entry delay) */
-int add_blocks_to_board()
+/* Returns the input for the game this frame, from all the keys read since the
+ * last one */
+Input read_input()
 {
-    int height = WINDOW_HEIGHT;
+    long long now = now_ns();
+    KeyEvent event;
+
+    while (!game_is_paused && key_queue_peek(&keyboard.queue, &event) && event.time_ns <= now) {
+        Input button = key_button(event.key);
 
-    for (int i = 0; i < 4; ++i) {
-        int x = ctetr.x + shapes[ctetr.shape_number][i][0];
-        int y = ctetr.y + shapes[ctetr.shape_number][i][1];
+        /* A second press of a button waits for the next frame */
+        if (button != INPUT_NONE && !controller_event(&controller, button, event.time_ns, now))
+            break;
 
-        if (x >= 0 && x < WINDOW_WIDTH && y >= 0 && y < WINDOW_HEIGHT)
-            blocks[x][y] = ctetr.type;
+        key_queue_pop(&keyboard.queue);
 
-        // "height" will be the minimum y value
-        if (y < height)
-            height = y;
+        if (button == INPUT_NONE)
+            handle_command(event.key);
     }
 
-    return height;
+    return controller_frame(&controller, now);
 }
 
-bool line_is_complete(int i)
+void update_game(Input input)
 {
-    for (int x = 0; x < WINDOW_WIDTH; ++x) {
-        if (!blocks[x][i])
-            return false;
+    /* When the AI plays, the keyboard is only used to pause or quit */
+    if (use_ai)
+        input = ai_player_input(&ai, &game);
+
+    /* Same thing when playing a replay */
+    if (replay_path != NULL && !replay_next_input(&replay, &input)) {
+        replay_is_over = true;
+        end_game = true;
+        return;
     }
 
-    return true;
-}
+    game_step(&game, input);
 
-void remove_line(int i)
-{
-    for (int j = i; j > 0; --j)
-        for (int x = 0; x < WINDOW_WIDTH; ++x)
-            blocks[x][j] = blocks[x][j-1];
+    if (record_path != NULL)
+        replay_record(&replay, input);
+
+    if (game.state == GAME_STATE_OVER)
+        end_game = true;
 
-    for (int x = 0; x < WINDOW_WIDTH; ++x)
-        blocks[x][0] = BLOCK_TYPE_NONE;
+    if (game.score > highscore)
+        highscore = game.score;
 }
 
-int score_factor(int nb_completed_lines)
+/* Runs of the same input, like "CW L3 .2 D9" where dots are frames without
+ * any button, cut to fit the hint box */
+void describe_inputs(const Input inputs[], int nb_inputs, char text[33])
 {
-    switch (nb_completed_lines)
-    {
-        case 0: return 0;
-        case 1: return 40;
-        case 2: return 100;
-        case 3: return 300;
-        case 4: return 1200;
-    }
+    int length = 0;
 
-    assert(0 && "Impossible number of lines cleared");
-}
+    text[0] = '\0';
 
-void highlight_line(int line_nb)
-{
-    wattron(game_box, COLOR_WHITE);
+    for (int i = 0; i < nb_inputs;) {
+        int run = 1;
+        char word[16];
 
-    for (int i = 0; i < WINDOW_WIDTH; ++i)
-        print_shiny_pixel(i, line_nb, game_box);
+        while (i + run < nb_inputs && inputs[i + run] == inputs[i])
+            ++run;
 
-    wattroff(game_box, COLOR_WHITE);
-}
+        const char* name = (inputs[i] == INPUT_LEFT) ? "L"
+                         : (inputs[i] == INPUT_RIGHT) ? "R"
+                         : (inputs[i] == INPUT_DOWN) ? "D"
+                         : (inputs[i] == INPUT_ROTATE_CW) ? "CW"
+                         : (inputs[i] == INPUT_ROTATE_CCW) ? "CCW" : ".";
+        int word_length = (run > 1) ? snprintf(word, sizeof(word), "%s%d ", name, run)
+                                    : snprintf(word, sizeof(word), "%s ", name);
 
-void check_for_complete_lines()
-{
-    int nb_completed_lines = 0;
-    int lines_to_be_removed[4] = {-1, -1, -1, -1};
-
-    /* Find the lines to be removed */
-    // @Optim : only do this for lines close to the fallen tetrimino
-    for (int i = 0; i < WINDOW_HEIGHT; ++i) {
-        if (line_is_complete(i)) {
-            lines_to_be_removed[nb_completed_lines] = i;
-            ++nb_completed_lines;
+        if (length + word_length > 32 - 3) {
+            strcpy(text + length, "...");
+            return;
         }
+
+        strcpy(text + length, word);
+        length += word_length;
+        i += run;
     }
+}
 
-    /* Highlight all lines to be removed */
-    for (int i = 0; i < nb_completed_lines; ++i)
-            highlight_line(lines_to_be_removed[i]);
-    wrefresh(game_box);
+void update_hint()
+{
+    if (!show_hint || game.state != GAME_STATE_FALLING || hint_piece == game.nb_pieces)
+        return;
 
-    /* Freeze for 20 frames */
-    if (nb_completed_lines > 0)
-        usleep(20*refresh_delay);
+    static Placement placements[PATH_NB_POSITIONS];
+    Input inputs[PATH_MAX_FRAMES];
+    char text[33];
 
-    /* Actually remove the lines */
-    for (int i = 0; i < nb_completed_lines; ++i)
-        remove_line(lines_to_be_removed[i]);
+    hint_piece = game.nb_pieces;
 
-    score += (level + 1) * score_factor(nb_completed_lines);
-    cleared_lines += nb_completed_lines;
-}
+    int nb_ends = path_search(&hint_search, &game);
 
-// See https://tetris.wiki/Tetris_(NES,_Nintendo) for the ARE formula used
-void do_entry_delay(int piece_height)
-{
-    usleep(refresh_delay * (18 - 2 * (piece_height / 4)));
-}
+    for (int i = 0; i < nb_ends; ++i)
+        placements[i] = hint_search.ends[i].placement;
 
-/* If the new piece (ctetr) can't fit, it's game over */
-void check_for_game_over()
-{
-    for (int i = 0; i < 4; ++i) {
-        int x = ctetr.x + shapes[ctetr.shape_number][i][0];
-        int y = ctetr.y + shapes[ctetr.shape_number][i][1];
+    int best = ai_choose_among(&game, &ai_default_weights, placements, nb_ends);
 
-        if (blocks[x][y]) {
-            end_game = true;
-            return;
-        }
+    if (best < 0) {
+        hide_hint();
+        return;
     }
-}
 
-bool can_move_down()
-{
-    for (int i = 0; i < 4; ++i) {
-        int x = ctetr.x + shapes[ctetr.shape_number][i][0];
-        int y = ctetr.y + shapes[ctetr.shape_number][i][1];
-
-        if (y < 0)
-            continue;
-        if (y >= WINDOW_HEIGHT - 1 || blocks[x][y + 1])
-            return false;
-    }
+    const PathEnd* end = &hint_search.ends[best];
 
-    return true;
+    describe_inputs(inputs, path_inputs(&hint_search, end, inputs), text);
+    draw_hint(&end->placement, text, end->nb_frames, end->nb_presses);
 }
 
-bool can_move_right()
+/* Keys other than p and q are ignored during the pause */
+void update_pause()
 {
-    for (int i = 0; i < 4; ++i) {
-        int x = ctetr.x + shapes[ctetr.shape_number][i][0];
-        int y = ctetr.y + shapes[ctetr.shape_number][i][1];
+    KeyEvent event;
 
-        if (x >= WINDOW_WIDTH - 1 || (y >= 0 && blocks[x + 1][y]))
-            return false;
-    }
+    while (game_is_paused && !end_game && key_queue_peek(&keyboard.queue, &event)) {
+        key_queue_pop(&keyboard.queue);
 
-    return true;
-}
+        switch (event.key) {
+            case 'p':
+                game_is_paused = false;
 
-bool can_move_left()
-{
-    for (int i = 0; i < 4; ++i) {
-        int x = ctetr.x + shapes[ctetr.shape_number][i][0];
-        int y = ctetr.y + shapes[ctetr.shape_number][i][1];
+                /* Buttons held before the pause are forgotten */
+                controller_init(&controller);
 
-        if (x <= 0 || (y >= 0 && blocks[x - 1][y]))
-            return false;
-    }
+                /* The pause box was drawn over the game */
+                invalidate_screen();
+                break;
 
-    return true;
+            case 'q':
+                end_game = true;
+        }
+    }
 }
 
-int new_fall_rate()
+/* Returns the exit status of the program */
+int check_replay_score()
 {
-    switch (level) {
-        case 0: return 48;
-        case 1: return 43;
-        case 2: return 38;
-        case 3: return 33;
-        case 4: return 28;
-        case 5: return 23;
-        case 6: return 18;
-        case 7: return 13;
-        case 8: return 8;
-        case 9: return 6;
-
-        case 10:
-        case 11:
-        case 12:
-            return 5;
-
-        case 13:
-        case 14:
-        case 15:
-            return 4;
-
-        case 16:
-        case 17:
-        case 18:
-            return 3;
+    if (game.score == replay.score) {
+        printf("Replay verified, the score matches the recorded one.\n");
+        return 0;
     }
 
-    if (level >= 19 && level <= 28)
-        return 2;
-    else if (level >= 29)
-        return 1;
-    else
-        assert(0 && "Impossible level value");
+    printf("Replay mismatch: the recorded score is %ld.\n", replay.score);
+    return 1;
 }
 
-void clear_buffered_inputs()
+int play_headless_replay()
 {
-    wtimeout(game_box, 0);
-    int last_input;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    replay_simulate(&replay, &game);
+    clock_gettime(CLOCK_MONOTONIC, &end);
 
-    do {
-        last_input = wgetch(game_box);
-    } while (last_input != ERR);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+    printf("Replayed %ld frames in %.3f ms (%.0f frames/s)\n", replay.nb_frames,
+           elapsed * 1e3, replay.nb_frames / elapsed);
+    printf("Score: %ld, lines: %d, level: %d\n", game.score, game.cleared_lines, game.level);
+
+    return check_replay_score();
 }
 
-void update_game()
+void play_game_over_animation()
 {
-    /*
-     * Get an input from the keyboard without waiting.
-     * This works pretty well and even seems to add inputs to an internal queue
-     * when they can't be treated right now.
-     */
-    wtimeout(game_box, 0);
-    int last_input = wgetch(game_box);
-
-    if (nb_frames % fall_rate == 0) {
-        if (!can_move_down()) {
-            int piece_height = add_blocks_to_board();
-            check_for_complete_lines();
-
-            clear_buffered_inputs();
-            do_entry_delay(piece_height);
-
-            get_new_tetrimino();
-            check_for_game_over();
-        } else {
-            ++ctetr.y;
-        }
-    }
+    nb_frames = 0;
 
-    /* Update the level if needed */
-    if (cleared_lines >= lines_before_next_level) {
-        ++level;
-        lines_before_next_level += 10;
-        fall_rate = new_fall_rate();
-        nb_frames = 0;
+    while (++nb_frames < curtain_frame_freq * (WINDOW_HEIGHT + 1)) {
+        draw_falling_curtain(nb_frames);
+        frame_clock_wait(&frame_clock);
     }
+}
 
-    switch (last_input) {
-        case 'h':
+/* Keys are sent to tetris-server as the characters of the game, arrows as hjkl */
+unsigned char key_byte(int key)
+{
+    switch (key) {
         case KEY_LEFT:
-            if (can_move_left())
-                --ctetr.x;
-            break;
+            return 'h';
 
-        case 'l':
         case KEY_RIGHT:
-            if (can_move_right())
-                ++ctetr.x;
-            break;
+            return 'l';
 
-        case 'j':
         case KEY_DOWN:
-            if (can_move_down()) {
-                ++ctetr.y;
-
-                /* Reset the timer when the tetrimino is about to be dropped as
-                 * to give the player a last chance to place it correctly
-                 * without any timer luck involved */
-                if (!can_move_down())
-                    nb_frames = 0;
-            }
-            break;
+            return 'j';
 
-        case 'k':
-        case 'c':
         case KEY_UP:
-            rotate_tetrimino(1);
-            break;
-
-        case 'e':
-        case 'x':
-            rotate_tetrimino(-1);
-            break;
-
-        case 'p':
-            game_is_paused = true;
-            break;
-
-        case 'q':
-            end_game = true;
+            return 'k';
     }
 
-    if (score > highscore)
-        highscore = score;
+    return key;
 }
 
-void update_pause()
+/*
+ * Draw the game served at path until it ends, or q is pressed. When playing
+ * on a tetris-server, the other keys are sent to it, after the level to start
+ * at.
+ */
+int watch_game(const char* path, bool play, int start_level)
 {
-    wtimeout(game_box, 0);
-    int last_input = wgetch(game_box);
+    if (!spectator_view_connect(&view, path)) {
+        fprintf(stderr, "Could not connect to a game at %s\n", path);
+        return 1;
+    }
 
-    switch (last_input) {
-        case 'p':
-            game_is_paused = false;
-            break;
+    unsigned char level = start_level;
 
-        case 'q':
-            end_game = true;
+    if (play && !spectator_view_send(&view, &level, 1)) {
+        spectator_view_close(&view);
+        fprintf(stderr, "Could not start a game at %s\n", path);
+        return 1;
     }
-}
-
-void display_current_tetrimino()
-{
-    wattron(game_box, COLOR_PAIR(ctetr.type));
 
-    for (int i = 0; i < 4; ++i) {
-        int x = ctetr.x + shapes[ctetr.shape_number][i][0];
-        int y = ctetr.y + shapes[ctetr.shape_number][i][1];
+    if (!init_render()) {
+        spectator_view_close(&view);
+        fprintf(stderr, "Could not set up the terminal\n");
+        return 1;
+    }
 
-        print_pixel(x, y, game_box);
+    if (!keyboard_start(&keyboard, STDIN_FILENO)) {
+        deinit_render();
+        spectator_view_close(&view);
+        fprintf(stderr, "Could not start reading the keyboard\n");
+        return 1;
     }
 
-    wattroff(game_box, COLOR_PAIR(ctetr.type));
-}
+    frame_clock_init(&frame_clock, refresh_delay);
 
-void display_next_tetrimino()
-{
-    int center_length = center_lengths[ntetr.type - 1];
+    bool was_paused = false;
 
-    wattron(next_piece_box, COLOR_PAIR(ntetr.type));
+    while (!end_game) {
+        KeyEvent event;
 
-    for (int i = 0; i < 4; ++i) {
-        int x = shapes[ntetr.shape_number][i][0];
-        int y = shapes[ntetr.shape_number][i][1];
+        while (key_queue_peek(&keyboard.queue, &event)) {
+            key_queue_pop(&keyboard.queue);
 
-        mvwaddch(next_piece_box, 1+y, 1 + center_length + 2*x, ACS_BLOCK);
-        mvwaddch(next_piece_box, 1+y, 2 + center_length + 2*x, ACS_BLOCK);
-    }
+            unsigned char byte = key_byte(event.key);
 
-    wattroff(next_piece_box, COLOR_PAIR(ntetr.type));
-}
+            if (event.key == 'q')
+                end_game = true;
+            else if (play && !spectator_view_send(&view, &byte, 1))
+                end_game = true;
+        }
 
-void display_game()
-{
-    // @Optim : don't clear the whole screen every frame
-    box(game_box, ACS_VLINE, ACS_HLINE);
+        if (!spectator_view_update(&view))
+            end_game = true;
 
-    display_current_tetrimino();
+        if (view.has_keyframe && view.frame.paused) {
+            draw_pause();
+        } else if (view.has_keyframe) {
+            /* The pause box was drawn over the game */
+            if (was_paused)
+                invalidate_screen();
+
+            draw_game(&view.frame.game, view.frame.highscore);
+        }
 
-    /*
-     * @Optim : is it better to loop over the matrix for each color, so we loop
-     * 7 times but we also change colors only 7 times, or to loop once and
-     * change the color for each block ?
-     */
+        was_paused = view.has_keyframe && view.frame.paused;
+        frame_clock_wait(&frame_clock);
+    }
+
+    play_game_over_animation();
 
-    /* Display already fallen tetriminos */
-    for (BlockType color = 1; color <= 7; ++color) {
-        wattron(game_box, COLOR_PAIR(color));
+    keyboard_stop(&keyboard);
+    deinit_render();
+    spectator_view_close(&view);
 
-        for (int x = 0; x < WINDOW_WIDTH; ++x)
-            for (int y = 0; y < WINDOW_HEIGHT; ++y)
-                if (blocks[x][y] == color)
-                    print_pixel(x, y, game_box);
+    tcflush(STDIN_FILENO, TCIFLUSH);
 
-        wattroff(game_box, COLOR_PAIR(color));
+    if (view.invalid) {
+        fprintf(stderr, "Could not follow the game at %s (or it is for another board size)\n",
+                path);
+        return 1;
     }
 
-    wrefresh(game_box);
-}
+    if (view.frame.game.state == GAME_STATE_OVER)
+        printf("Game over!\n");
 
-void display_level()
-{
-    box(level_box, ACS_VLINE, ACS_HLINE);
-    mvwprintw(level_box, 0, 1, "Level");
-    mvwprintw(level_box, 1, 1, "%ld", level);
+    if (view.has_keyframe)
+        printf("Score: %ld, lines: %d, level: %d\n", view.frame.game.score,
+               view.frame.game.cleared_lines, view.frame.game.level);
 
-    wrefresh(level_box);
+    return 0;
 }
 
-void display_score()
+int main(int argc, char* argv[])
 {
-    box(score_box, ACS_VLINE, ACS_HLINE);
-    mvwprintw(score_box, 0, 1, "Score");
-    mvwprintw(score_box, 1, 1, "%ld", score);
+    int start_level = 0;
+
+    /* Different for every game unless given */
+    uint16_t seed = time(NULL) ^ getpid();
+
+    /* Parse the command line for options, or the level to start at */
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--stats") == 0)
+            print_stats = true;
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = strtol(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            record_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replay_path = argv[++i];
+        else if (strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if (strcmp(argv[i], "--ai") == 0)
+            use_ai = true;
+        else if (strcmp(argv[i], "--timings") == 0 && i + 1 < argc)
+            timings_path = argv[++i];
+        else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+            search_depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--highscores") == 0)
+            show_highscores = true;
+        else if (strcmp(argv[i], "--ansi") == 0)
+            render_backend = RENDER_BACKEND_ANSI;
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+            serve_path = argv[++i];
+        else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc)
+            watch_path = argv[++i];
+        else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc)
+            connect_path = argv[++i];
+        else
+            start_level = atoi(argv[i]);
+    }
 
-    wrefresh(score_box);
-}
+    if (show_highscores) {
+        init_highscore_info();
+        if (!read_highscore())
+            fprintf(stderr, "Could not read the highscores from %s\n", high_score_file);
+        print_highscores();
+        deinit_highscore_info();
+        return 0;
+    }
 
-void display_next_piece()
-{
-    box(next_piece_box, ACS_VLINE, ACS_HLINE);
-    mvwprintw(next_piece_box, 0, 1, "Next");
+    if (watch_path != NULL)
+        return watch_game(watch_path, false, 0);
 
-    display_next_tetrimino();
+    if (connect_path != NULL)
+        return watch_game(connect_path, true, start_level);
 
-    wrefresh(next_piece_box);
-}
+    if (replay_path != NULL) {
+        if (!replay_load(&replay, replay_path)) {
+            fprintf(stderr, "Could not read the replay %s (or it is for another board size)\n",
+                    replay_path);
+            return 1;
+        }
 
-void display_highscore()
-{
-    box(highscore_box, ACS_VLINE, ACS_HLINE);
-    mvwprintw(highscore_box, 0, 1, "Highscore");
-    mvwprintw(highscore_box, 1, 1, "%ld", highscore);
+        if (headless)
+            return play_headless_replay();
 
-    wrefresh(highscore_box);
-}
+        start_level = replay.start_level;
+        seed = replay.seed;
+    }
 
-void display_lines()
-{
-    box(lines_box, ACS_VLINE, ACS_HLINE);
-    mvwprintw(lines_box, 0, 1, "Lines");
-    mvwprintw(lines_box, 1, 1, "%ld", cleared_lines);
+    if (!init_render()) {
+        fprintf(stderr, "Could not set up the terminal\n");
+        return 1;
+    }
 
-    wrefresh(lines_box);
-}
+    init_highscore_info(); // must be done before read_highscore
+    bool highscores_read = read_highscore();
 
-void draw_game()
-{
-    clear();
-
-    display_game();
-    display_score();
-    display_level();
-    display_next_piece();
-    display_highscore();
-    display_lines();
-}
+    game_init(&game, start_level, seed);
 
-void draw_falling_curtain()
-{
-    wattron(game_box, COLOR_PAIR(4));
+    if (record_path != NULL)
+        replay_init(&replay, game.seed, start_level);
 
-    for (int j = 0; j < nb_frames / curtain_frame_freq; ++j)
-        for (int i = 0; i < WINDOW_WIDTH; ++i)
-            print_shiny_pixel(i, j, game_box);
+    if (use_ai) {
+        ai_player_init(&ai, &ai_default_weights);
 
-    wattroff(game_box, COLOR_PAIR(4));
-    wrefresh(game_box);
-}
+        /* The search has to fit in a frame, so it uses every core */
+        if (search_depth > 0) {
+            search_limits = search_default_limits;
+            search_limits.depth = search_depth;
+            search_limits.nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+            ai.search = search_create(&search_limits);
+        }
+    }
 
-void draw_pause()
-{
-    box(pause_box, ACS_VLINE, ACS_HLINE);
-    mvwprintw(pause_box, 1, 1, "Paused");
+    controller_init(&controller);
 
-    wrefresh(pause_box);
-}
+    if (!keyboard_start(&keyboard, STDIN_FILENO)) {
+        deinit_render();
+        fprintf(stderr, "Could not start reading the keyboard\n");
+        return 1;
+    }
 
-int main(int argc, char* argv[])
-{
-    /* Parse the command line for starting at a given level */
-    if (argc > 1)
-        start_level = atoi(argv[1]);
-
-    level = start_level;
-    fall_rate = new_fall_rate();
-
-    /* For the starting level, this is the formula to get the lines to be
-     * cleared before getting to the next one. After that, a new level is
-     * reached after clearing 10 lines. See https://tetris.wiki/Scoring
-     */
-    lines_before_next_level = min(10 * start_level + 10, max(100, 10 * start_level - 50));
-
-    /* Initialize ncurses */
-    initscr();       // Initialize the window
-    noecho();        // Don't echo the key presses
-    curs_set(false); // Don't display the cursor
-    cbreak();        // Get input character by character
-    start_color();   // Use colors
-
-    /* Initialize the colors */
-    use_default_colors();
-    init_pair(1, COLOR_CYAN, -1);     /* I tetrimino */
-    init_pair(2, COLOR_YELLOW, -1);   /* O tetrimino */
-    init_pair(3, COLOR_MAGENTA, -1);  /* T tetrimino */
-    init_pair(4, -1, -1);             /* L tetrimino */  /* foreground color */
-    init_pair(5, COLOR_BLUE, -1);     /* J tetrimino */
-    init_pair(6, COLOR_RED, -1);      /* Z tetrimino */
-    init_pair(7, COLOR_GREEN, -1);    /* S tetrimino */
-
-    /* Initialize the seed used to randomly spawn tetriminos */
-    srand(time(NULL));
-
-    /* Initialize game window */
-    game_box = subwin(stdscr, WINDOW_HEIGHT + 2, 2*WINDOW_WIDTH + 2, 0, 0);
-    box(game_box, ACS_VLINE, ACS_HLINE);
-    wrefresh(game_box);
-    keypad(game_box, true); // Enable arrow keys
-
-    /* Initialize level window */
-    level_box = subwin(stdscr, 1 + 2, WINDOW_WIDTH + 2, 2, 2*WINDOW_WIDTH + 2);
-    box(level_box, ACS_VLINE, ACS_HLINE);
-    wrefresh(level_box);
-
-    /* Initialize lines window */
-    lines_box = subwin(stdscr, 1 + 2, WINDOW_WIDTH + 2, 5, 2*WINDOW_WIDTH + 2);
-    box(lines_box, ACS_VLINE, ACS_HLINE);
-    wrefresh(lines_box);
-
-    /* Initialize next piece window */
-    next_piece_box = subwin(stdscr, 2 + 2, WINDOW_WIDTH + 2, 9, 2*WINDOW_WIDTH + 2);
-    box(next_piece_box, ACS_VLINE, ACS_HLINE);
-    wrefresh(next_piece_box);
-
-    /* Initialize score window */
-    score_box = subwin(stdscr, 1 + 2, WINDOW_WIDTH + 2, 14, 2*WINDOW_WIDTH + 2);
-    box(score_box, ACS_VLINE, ACS_HLINE);
-    wrefresh(score_box);
-
-    /* Initialize highscore window */
-    highscore_box = subwin(stdscr, 1 + 2, WINDOW_WIDTH + 2, 17, 2*WINDOW_WIDTH + 2);
-    box(highscore_box, ACS_VLINE, ACS_HLINE);
-    wrefresh(highscore_box);
-
-    /* Initialize pause window */
-    pause_box = subwin(stdscr, 3, 8, WINDOW_HEIGHT / 2, 7);
-    box(pause_box, ACS_VLINE, ACS_HLINE);
-    wrefresh(pause_box);
+    if (serve_path != NULL && !spectator_server_start(&spectators, serve_path)) {
+        keyboard_stop(&keyboard);
+        deinit_render();
+        fprintf(stderr, "Could not serve the game at %s\n", serve_path);
+        return 1;
+    }
 
-    init_highscore_info(); // must be done before read_highscore
-    read_highscore();
+    frame_clock_init(&frame_clock, refresh_delay);
 
-    /* Initialize the tetriminos */
-    ntetr = make_new_tetrimino(1 + rand() % 7);
-    get_new_tetrimino();
+    frame_stats_init(&frame_stats);
 
     /* Main game loop */
     while (!end_game) {
         if (!game_is_paused) {
-            update_game();
-            draw_game();
+            frame_stats_begin(&frame_stats, FRAME_PHASE_INPUT);
+            Input input = read_input();
+            frame_stats_begin(&frame_stats, FRAME_PHASE_UPDATE);
+            update_game(input);
+
+            /* If drawing or the host was too slow, update the frames we are
+             * late on without drawing them so the game speed stays steady */
+            while (!end_game && !game_is_paused && frame_clock_is_late(&frame_clock)) {
+                frame_stats_begin(&frame_stats, FRAME_PHASE_INPUT);
+                input = read_input();
+                frame_stats_begin(&frame_stats, FRAME_PHASE_UPDATE);
+                update_game(input);
+            }
+
+            frame_stats_begin(&frame_stats, FRAME_PHASE_DRAW);
+
+            if (show_frame_stats && atomic_load(&frame_stats.nb_frames) % frame_stats_refresh_freq == 0) {
+                PhaseSummary summaries[NB_FRAME_PHASES];
+                int nb_frames = frame_stats_summarise(&frame_stats, summaries);
 
-            // @Hack : this makes the game run at an unpredictable frame rate
-            usleep(refresh_delay);
+                draw_frame_stats(summaries, nb_frames);
+            }
+
+            update_hint();
+            draw_game(&game, highscore);
+
+            if (serve_path != NULL)
+                spectator_server_publish(&spectators, &game, highscore, false);
+
+            frame_stats_begin(&frame_stats, FRAME_PHASE_SLACK);
+            frame_clock_wait(&frame_clock);
+            frame_stats_end_frame(&frame_stats);
         } else {
             update_pause();
             draw_pause();
 
+            if (serve_path != NULL)
+                spectator_server_publish(&spectators, &game, highscore, game_is_paused);
+
             // When paused, the game doesn't need to be updated as frequently.
-            usleep(10*refresh_delay);
+            frame_clock_wait_frames(&frame_clock, 10);
         }
-
-        ++nb_frames;
     }
 
-    nb_frames = 0;
+    /* The spectators play the animation on their side */
+    if (serve_path != NULL)
+        spectator_server_stop(&spectators);
 
-    /* Play the game over animation */
-    while (++nb_frames < curtain_frame_freq * (WINDOW_HEIGHT + 1)) {
-        draw_falling_curtain();
-        usleep(refresh_delay);
-    }
+    play_game_over_animation();
 
-    /* Close ncurses */
-    endwin();
+    keyboard_stop(&keyboard);
+    deinit_render();
 
-    update_highscore();
+    if (!highscores_read)
+        fprintf(stderr, "Could not read the highscores from %s\n", high_score_file);
+
+    /* Replays and AI games don't count for the highscores */
+    if (replay_path == NULL && !use_ai && game.score > 0)
+        update_highscore();
     deinit_highscore_info();
 
     /* Avoid printing the last inputted keys in the command line */
-    clear_buffered_inputs();
+    tcflush(STDIN_FILENO, TCIFLUSH);
 
-    printf("Game over!\nYour score is: %ld\n", score);
+    printf("Game over!\nYour score is: %ld\n", game.score);
+    printf("Seed: %u\n", game.seed);
 
-    if (highscore > old_highscore)
+    if (highscore_rank == 0 && game.score > old_highscore)
         printf("This is a new highscore!\n");
-    
-    return 0;
+    else if (highscore_rank > 0)
+        printf("Rank %d in the highscores (--highscores to see them)\n", highscore_rank + 1);
+
+    int status = 0;
+
+    if (record_path != NULL) {
+        replay_finish(&replay, game.score);
+
+        if (!replay_save(&replay, record_path)) {
+            fprintf(stderr, "Could not write the replay to %s\n", record_path);
+            status = 1;
+        }
+    }
+
+    if (replay_path != NULL) {
+        if (replay_is_over || game.state == GAME_STATE_OVER)
+            status = check_replay_score();
+        else
+            printf("Replay interrupted.\n");
+    }
+
+    replay_free(&replay);
+
+    if (ai.search != NULL)
+        search_destroy(ai.search);
+
+    if (timings_path != NULL) {
+        FILE* file = fopen(timings_path, "w");
+
+        if (file != NULL) {
+            frame_stats_dump(&frame_stats, file);
+            fclose(file);
+        } else {
+            fprintf(stderr, "Could not write the frame timings to %s\n", timings_path);
+            status = 1;
+        }
+    }
+
+    if (print_stats) {
+        printf("\nFrames: %ld (%ld updated late, %ld dropped)\n",
+               frame_clock.nb_frames, frame_clock.nb_late_frames,
+               frame_clock.nb_dropped_frames);
+        printf("Frame jitter: %ld us mean, %ld us max\n",
+               frame_clock_mean_jitter_ns(&frame_clock) / 1000,
+               frame_clock.max_jitter_ns / 1000);
+
+        if (controller.nb_presses > 0)
+            printf("Input latency: %lld us mean, %lld us max (%ld key presses)\n",
+                   controller.total_latency_ns / controller.nb_presses / 1000,
+                   controller.max_latency_ns / 1000, controller.nb_presses);
+
+        if (render_backend == RENDER_BACKEND_ANSI && ansi_stats.nb_frames > 0)
+            printf("Output: %.1f bytes and %.2f writes per frame drawn (%ld frames)\n",
+                   (double)ansi_stats.nb_bytes / ansi_stats.nb_frames,
+                   (double)ansi_stats.nb_writes / ansi_stats.nb_frames, ansi_stats.nb_frames);
+
+        if (serve_path != NULL)
+            printf("Spectators: %ld connections, %ld messages, %ld bytes sent, "
+                   "%ld times too far behind\n", spectators.nb_connections,
+                   spectators.nb_messages, spectators.nb_bytes, spectators.nb_overflows);
+    }
+
+    return status;
 }